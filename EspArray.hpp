@@ -1,117 +1,597 @@
 #pragma once
 #include<assert.h>
 #include<memory>
+#include<algorithm>
+#include<iterator>
+#include<thread>
+#include<type_traits>
 #ifndef __ESPARRAY__
 #define __ESPARRAY__
 #endif
 template<class EspType>
-class EspArray
+struct EspVoid { typedef void type; };
+//Types that can be moved with memcpy/realloc: trivially copyable ones, or classes declaring "typedef void EspRelocatable;"
+template<class EspType, class = void>
+struct EspIsRelocatable : std::integral_constant<bool, std::is_trivially_copyable<EspType>::value> {};
+template<class EspType>
+struct EspIsRelocatable<EspType, typename EspVoid<typename EspType::EspRelocatable>::type> : std::true_type {};
+
+template<class EspType>
+struct EspLess
+{
+	bool operator()(const EspType& Element1, const EspType& Element2)const { return Element1 < Element2; }
+};
+
+//Pattern-defeating quicksort; trivially copyable types use the branchless block partition
+template<class EspType, class CompareType>
+class EspPdqSort
+{
+private:
+	static const unsigned int InsertionSortThreshold = 24;
+	static const unsigned int NintherThreshold = 128;
+	static const unsigned int PartialInsertionSortLimit = 8;
+	static const unsigned int BlockSize = 64;
+	static const unsigned int ParallelThreshold = 1 << 15;
+
+	static void Swap(EspType& Element1, EspType& Element2)
+	{
+		using std::swap;
+		swap(Element1, Element2);
+	}
+	static void Sort2(EspType* Element1, EspType* Element2, CompareType& Comp)
+	{
+		if (Comp(*Element2, *Element1))
+			EspPdqSort::Swap(*Element1, *Element2);
+	}
+	static void Sort3(EspType* Element1, EspType* Element2, EspType* Element3, CompareType& Comp)
+	{
+		EspPdqSort::Sort2(Element1, Element2, Comp);
+		EspPdqSort::Sort2(Element2, Element3, Comp);
+		EspPdqSort::Sort2(Element1, Element2, Comp);
+	}
+	static void InsertionSort(EspType* Begin, EspType* End, CompareType& Comp, bool Guarded)
+	{
+		if (Begin == End)
+			return;
+		for (EspType* Cur = Begin + 1; Cur != End; ++Cur)
+		{
+			EspType* Sift = Cur;
+			EspType* Sift1 = Cur - 1;
+			if (Comp(*Sift, *Sift1))
+			{
+				EspType Temp(std::move(*Sift));
+				do
+					*Sift-- = std::move(*Sift1);
+				while ((!Guarded || Sift != Begin) && Comp(Temp, *--Sift1));
+				*Sift = std::move(Temp);
+			}
+		}
+	}
+	static bool PartialInsertionSort(EspType* Begin, EspType* End, CompareType& Comp)
+	{
+		if (Begin == End)
+			return true;
+		unsigned int Limit = 0;
+		for (EspType* Cur = Begin + 1; Cur != End; ++Cur)
+		{
+			EspType* Sift = Cur;
+			EspType* Sift1 = Cur - 1;
+			if (Comp(*Sift, *Sift1))
+			{
+				EspType Temp(std::move(*Sift));
+				do
+					*Sift-- = std::move(*Sift1);
+				while (Sift != Begin && Comp(Temp, *--Sift1));
+				*Sift = std::move(Temp);
+				Limit += Cur - Sift;
+			}
+			if (Limit > PartialInsertionSortLimit)
+				return false;
+		}
+		return true;
+	}
+	static EspType* PartitionLeft(EspType* Begin, EspType* End, CompareType& Comp)
+	{
+		EspType Pivot(std::move(*Begin));
+		EspType* First = Begin;
+		EspType* Last = End;
+		while (Comp(Pivot, *--Last));
+		if (Last + 1 == End)
+			while (First < Last && !Comp(Pivot, *++First));
+		else
+			while (!Comp(Pivot, *++First));
+		while (First < Last)
+		{
+			EspPdqSort::Swap(*First, *Last);
+			while (Comp(Pivot, *--Last));
+			while (!Comp(Pivot, *++First));
+		}
+		*Begin = std::move(*Last);
+		*Last = std::move(Pivot);
+		return Last;
+	}
+	static EspType* PartitionRight(EspType* Begin, EspType* End, CompareType& Comp, bool& AlreadyPartitioned)
+	{
+		EspType Pivot(std::move(*Begin));
+		EspType* First = Begin;
+		EspType* Last = End;
+		while (Comp(*++First, Pivot));
+		if (First - 1 == Begin)
+			while (First < Last && !Comp(*--Last, Pivot));
+		else
+			while (!Comp(*--Last, Pivot));
+		AlreadyPartitioned = First >= Last;
+		while (First < Last)
+		{
+			EspPdqSort::Swap(*First, *Last);
+			while (Comp(*++First, Pivot));
+			while (!Comp(*--Last, Pivot));
+		}
+		EspType* PivotPos = First - 1;
+		*Begin = std::move(*PivotPos);
+		*PivotPos = std::move(Pivot);
+		return PivotPos;
+	}
+	static void SwapOffsets(EspType* First, EspType* Last, unsigned char* OffsetsLeft, unsigned char* OffsetsRight, unsigned int Num, bool UseSwaps)
+	{
+		if (UseSwaps)
+		{
+			for (unsigned int TimeNum = 0; TimeNum < Num; TimeNum++)
+				EspPdqSort::Swap(*(First + OffsetsLeft[TimeNum]), *(Last - OffsetsRight[TimeNum]));
+		}
+		else if (Num > 0)
+		{
+			EspType* Left = First + OffsetsLeft[0];
+			EspType* Right = Last - OffsetsRight[0];
+			EspType Temp(std::move(*Left));
+			*Left = std::move(*Right);
+			for (unsigned int TimeNum = 1; TimeNum < Num; TimeNum++)
+			{
+				Left = First + OffsetsLeft[TimeNum];
+				*Right = std::move(*Left);
+				Right = Last - OffsetsRight[TimeNum];
+				*Left = std::move(*Right);
+			}
+			*Right = std::move(Temp);
+		}
+	}
+	static EspType* PartitionRightBranchless(EspType* Begin, EspType* End, CompareType& Comp, bool& AlreadyPartitioned)
+	{
+		EspType Pivot(std::move(*Begin));
+		EspType* First = Begin;
+		EspType* Last = End;
+		while (Comp(*++First, Pivot));
+		if (First - 1 == Begin)
+			while (First < Last && !Comp(*--Last, Pivot));
+		else
+			while (!Comp(*--Last, Pivot));
+		AlreadyPartitioned = First >= Last;
+		if (!AlreadyPartitioned)
+		{
+			EspPdqSort::Swap(*First, *Last);
+			++First;
+			//BlockQuicksort: record misplaced offsets without branching, then swap them in bulk
+			unsigned char OffsetsLeft[BlockSize];
+			unsigned char OffsetsRight[BlockSize];
+			EspType* OffsetsLeftBase = First;
+			EspType* OffsetsRightBase = Last;
+			unsigned int NumLeft = 0, NumRight = 0, StartLeft = 0, StartRight = 0;
+			while (First < Last)
+			{
+				unsigned int NumUnknown = Last - First;
+				unsigned int LeftSplit = NumLeft == 0 ? (NumRight == 0 ? NumUnknown / 2 : NumUnknown) : 0;
+				unsigned int RightSplit = NumRight == 0 ? (NumUnknown - LeftSplit) : 0;
+				if (LeftSplit > BlockSize)
+					LeftSplit = BlockSize;
+				if (RightSplit > BlockSize)
+					RightSplit = BlockSize;
+				for (unsigned int TimeNum = 0; TimeNum < LeftSplit;)
+				{
+					OffsetsLeft[NumLeft] = (unsigned char)TimeNum++;
+					NumLeft += !Comp(*First, Pivot);
+					++First;
+				}
+				for (unsigned int TimeNum = 0; TimeNum < RightSplit;)
+				{
+					OffsetsRight[NumRight] = (unsigned char)++TimeNum;
+					NumRight += Comp(*--Last, Pivot);
+				}
+				unsigned int Num = NumLeft < NumRight ? NumLeft : NumRight;
+				EspPdqSort::SwapOffsets(OffsetsLeftBase, OffsetsRightBase, OffsetsLeft + StartLeft, OffsetsRight + StartRight, Num, NumLeft == NumRight);
+				NumLeft -= Num;
+				NumRight -= Num;
+				StartLeft += Num;
+				StartRight += Num;
+				if (NumLeft == 0)
+				{
+					StartLeft = 0;
+					OffsetsLeftBase = First;
+				}
+				if (NumRight == 0)
+				{
+					StartRight = 0;
+					OffsetsRightBase = Last;
+				}
+			}
+			if (NumLeft != 0)
+			{
+				while (NumLeft--)
+					EspPdqSort::Swap(*(OffsetsLeftBase + OffsetsLeft[StartLeft + NumLeft]), *--Last);
+				First = Last;
+			}
+			if (NumRight != 0)
+			{
+				while (NumRight--)
+					EspPdqSort::Swap(*(OffsetsRightBase - OffsetsRight[StartRight + NumRight]), *First), ++First;
+				Last = First;
+			}
+		}
+		EspType* PivotPos = First - 1;
+		*Begin = std::move(*PivotPos);
+		*PivotPos = std::move(Pivot);
+		return PivotPos;
+	}
+	static void SortLoop(EspType* Begin, EspType* End, CompareType Comp, unsigned int BadAllowed, bool LeftMost, unsigned int ParallelDepth)
+	{
+		while (true)
+		{
+			unsigned int Size = End - Begin;
+			if (Size < InsertionSortThreshold)
+			{
+				EspPdqSort::InsertionSort(Begin, End, Comp, LeftMost);
+				return;
+			}
+			unsigned int Half = Size / 2;
+			if (Size > NintherThreshold)
+			{
+				EspPdqSort::Sort3(Begin, Begin + Half, End - 1, Comp);
+				EspPdqSort::Sort3(Begin + 1, Begin + (Half - 1), End - 2, Comp);
+				EspPdqSort::Sort3(Begin + 2, Begin + (Half + 1), End - 3, Comp);
+				EspPdqSort::Sort3(Begin + (Half - 1), Begin + Half, Begin + (Half + 1), Comp);
+				EspPdqSort::Swap(*Begin, *(Begin + Half));
+			}
+			else
+				EspPdqSort::Sort3(Begin + Half, Begin, End - 1, Comp);
+			//Runs of elements equal to the left neighbour's pivot go to the left and are never touched again
+			if (!LeftMost && !Comp(*(Begin - 1), *Begin))
+			{
+				Begin = EspPdqSort::PartitionLeft(Begin, End, Comp) + 1;
+				continue;
+			}
+			bool AlreadyPartitioned;
+			EspType* PivotPos = std::is_trivially_copyable<EspType>::value ?
+				EspPdqSort::PartitionRightBranchless(Begin, End, Comp, AlreadyPartitioned) :
+				EspPdqSort::PartitionRight(Begin, End, Comp, AlreadyPartitioned);
+			unsigned int LeftSize = PivotPos - Begin;
+			unsigned int RightSize = End - (PivotPos + 1);
+			if (LeftSize < Size / 8 || RightSize < Size / 8)
+			{
+				if (--BadAllowed == 0)
+				{
+					std::make_heap(Begin, End, Comp);
+					std::sort_heap(Begin, End, Comp);
+					return;
+				}
+				if (LeftSize >= InsertionSortThreshold)
+				{
+					EspPdqSort::Swap(*Begin, *(Begin + LeftSize / 4));
+					EspPdqSort::Swap(*(PivotPos - 1), *(PivotPos - LeftSize / 4));
+					if (LeftSize > NintherThreshold)
+					{
+						EspPdqSort::Swap(*(Begin + 1), *(Begin + (LeftSize / 4 + 1)));
+						EspPdqSort::Swap(*(Begin + 2), *(Begin + (LeftSize / 4 + 2)));
+						EspPdqSort::Swap(*(PivotPos - 2), *(PivotPos - (LeftSize / 4 + 1)));
+						EspPdqSort::Swap(*(PivotPos - 3), *(PivotPos - (LeftSize / 4 + 2)));
+					}
+				}
+				if (RightSize >= InsertionSortThreshold)
+				{
+					EspPdqSort::Swap(*(PivotPos + 1), *(PivotPos + (1 + RightSize / 4)));
+					EspPdqSort::Swap(*(End - 1), *(End - RightSize / 4));
+					if (RightSize > NintherThreshold)
+					{
+						EspPdqSort::Swap(*(PivotPos + 2), *(PivotPos + (2 + RightSize / 4)));
+						EspPdqSort::Swap(*(PivotPos + 3), *(PivotPos + (3 + RightSize / 4)));
+						EspPdqSort::Swap(*(End - 2), *(End - (1 + RightSize / 4)));
+						EspPdqSort::Swap(*(End - 3), *(End - (2 + RightSize / 4)));
+					}
+				}
+			}
+			else if (AlreadyPartitioned && EspPdqSort::PartialInsertionSort(Begin, PivotPos, Comp) &&
+				EspPdqSort::PartialInsertionSort(PivotPos + 1, End, Comp))
+				return;
+			if (ParallelDepth > 0 && LeftSize >= ParallelThreshold && RightSize >= ParallelThreshold)
+			{
+				std::thread Worker(&EspPdqSort::SortLoop, Begin, PivotPos, Comp, BadAllowed, LeftMost, ParallelDepth - 1);
+				EspPdqSort::SortLoop(PivotPos + 1, End, Comp, BadAllowed, false, ParallelDepth - 1);
+				Worker.join();
+				return;
+			}
+			EspPdqSort::SortLoop(Begin, PivotPos, Comp, BadAllowed, LeftMost, 0);
+			Begin = PivotPos + 1;
+			LeftMost = false;
+		}
+	}
+
+public:
+	static void Sort(EspType* Begin, EspType* End, CompareType Comp, bool Parallel = false)
+	{
+		if (End - Begin < 2)
+			return;
+		unsigned int BadAllowed = 1;
+		for (unsigned int Size = End - Begin; Size > 1; Size >>= 1)
+			BadAllowed++;
+		unsigned int ParallelDepth = 0;
+		if (Parallel)
+			for (unsigned int Threads = std::thread::hardware_concurrency(); Threads > 1; Threads >>= 1)
+				ParallelDepth++;
+		EspPdqSort::SortLoop(Begin, End, Comp, BadAllowed, true, ParallelDepth);
+	}
+};
+template<class EspType>
+void EspSortElements(EspType* ArrayData, unsigned int ArraySize, bool Parallel)
+{
+	EspPdqSort<EspType, EspLess<EspType>>::Sort(ArrayData, ArrayData + ArraySize, EspLess<EspType>(), Parallel);
+}
+
+template<class EspType, unsigned int InlineCount>
+class EspArrayInlineStorage
+{
+protected:
+	alignas(EspType) unsigned char InlineBuffer[InlineCount * sizeof(EspType)];
+	EspType* GetInlineData()const { return (EspType*)InlineBuffer; }
+};
+template<class EspType>
+class EspArrayInlineStorage<EspType, 0>
+{
+protected:
+	EspType* GetInlineData()const { return NULL; }
+};
+
+//InlineCount > 0 keeps the first elements inside the object and only spills to the heap beyond that (see EspSmallArray)
+template<class EspType, unsigned int InlineCount = 0>
+class EspArray :private EspArrayInlineStorage<EspType, InlineCount>
 {
 private:
+	static const bool Relocatable = EspIsRelocatable<EspType>::value;
+
 	EspType* ArrayData;
 	unsigned int ArraySize;
 	unsigned int AllocSize;
 
-public:
-	EspArray()
+	bool IsInline()const { return InlineCount > 0 && ArrayData == this->GetInlineData(); }
+	void ReleaseBuffer()
 	{
-		ArrayData = NULL;
-		ArraySize = AllocSize = 0;
+		if (ArrayData != NULL && !IsInline())
+			::free(ArrayData);
+		ArrayData = this->GetInlineData();
+		AllocSize = InlineCount;
 	}
-	~EspArray()
+	//Moves the elements into NewArrayData, which must not overlap the current buffer
+	void RelocateTo(EspType* NewArrayData)
 	{
-		if (ArrayData != NULL)
+		if (Relocatable)
 		{
+			if (ArraySize > 0)
+				::memcpy((void*)NewArrayData, (void*)ArrayData, ArraySize * sizeof(EspType));
+		}
+		else
 			for (unsigned int TimeNum = 0; TimeNum < ArraySize; TimeNum++)
+			{
+				::new(NewArrayData + TimeNum)EspType(std::move(ArrayData[TimeNum]));
 				(ArrayData + TimeNum)->~EspType();
-			::free(ArrayData);
-		}
-		ArrayData = NULL;
-		ArraySize = AllocSize = 0;
+			}
 	}
-
-	void AddElement(const EspType& NewElement)
+	void Reallocate(unsigned int NewAllocSize)
 	{
-		if (ArrayData == NULL)
+		EspType* NewArrayData;
+		if (Relocatable && !IsInline())
 		{
-			ArrayData = (EspType*)::malloc(2 * sizeof(EspType));
-			::new(ArrayData)EspType;
-			//::memcpy(ArrayData, &NewElement, sizeof(EspType));
-			ArrayData[0] = NewElement;
-			::memset(ArrayData + 1, 0, sizeof(EspType));
-			ArraySize = 1;
-			AllocSize = 2;
+			NewArrayData = (EspType*)::realloc((void*)ArrayData, NewAllocSize * sizeof(EspType));
+			if (NewArrayData == NULL)
+				throw("Allocate Buffer Unsuccessfully!");
 		}
 		else
 		{
-			unsigned int NewArraySize = ArraySize + 1;
-			if (NewArraySize <= AllocSize)
+			NewArrayData = (EspType*)::malloc(NewAllocSize * sizeof(EspType));
+			if (NewArrayData == NULL)
+				throw("Allocate Buffer Unsuccessfully!");
+			RelocateTo(NewArrayData);
+			ReleaseBuffer();
+		}
+		ArrayData = NewArrayData;
+		AllocSize = NewAllocSize;
+	}
+	void GrowFor(unsigned int NewArraySize)
+	{
+		if (NewArraySize > AllocSize)
+			Reallocate(NewArraySize * 2);
+	}
+	//Shifts [Index, ArraySize) right by Count, leaving raw storage behind; capacity must already suffice
+	void OpenGap(unsigned int Index, unsigned int Count)
+	{
+		if (Relocatable)
+			::memmove((void*)(ArrayData + Index + Count), (void*)(ArrayData + Index), (ArraySize - Index) * sizeof(EspType));
+		else
+			for (unsigned int TimeNum = ArraySize; TimeNum > Index; TimeNum--)
 			{
-				::new(ArrayData + ArraySize)EspType;
-				ArrayData[ArraySize] = NewElement;
-				ArraySize = NewArraySize;
+				::new(ArrayData + TimeNum - 1 + Count)EspType(std::move(ArrayData[TimeNum - 1]));
+				(ArrayData + TimeNum - 1)->~EspType();
 			}
-			else
+	}
+	//Moves [Index + Count, ArraySize) left over raw storage whose elements were already destroyed
+	void CloseGap(unsigned int Index, unsigned int Count)
+	{
+		if (Relocatable)
+			::memmove((void*)(ArrayData + Index), (void*)(ArrayData + Index + Count), (ArraySize - Index - Count) * sizeof(EspType));
+		else
+			for (unsigned int TimeNum = Index; TimeNum + Count < ArraySize; TimeNum++)
 			{
-				unsigned int NewAllocSize = NewArraySize * 2;
-				EspType* NewArrayData = (EspType*)::malloc(NewAllocSize * sizeof(EspType));
-				if (NewArrayData == NULL)
-					throw("Allocate Buffer Unsuccessfully!");
-				::memcpy(NewArrayData, ArrayData, ArraySize * sizeof(EspType));
-				::new(NewArrayData + ArraySize)EspType;
-				NewArrayData[ArraySize] = NewElement;
-				::memset(NewArrayData + NewArraySize, 0, (NewAllocSize - NewArraySize) * sizeof(EspType));
-				::free(ArrayData);
-				ArrayData = NewArrayData;
-				ArraySize = NewArraySize;
-				AllocSize = NewAllocSize;
+				::new(ArrayData + TimeNum)EspType(std::move(ArrayData[TimeNum + Count]));
+				(ArrayData + TimeNum + Count)->~EspType();
 			}
-		}
 	}
-	void AddArray(const EspArray<EspType>& NewArray)
+	//Leaves Count raw slots at Index, moving the tail only once even when the buffer has to grow
+	void MakeRoom(unsigned int Index, unsigned int Count)
 	{
-		if (ArrayData == NULL)
+		unsigned int NewArraySize = ArraySize + Count;
+		if (NewArraySize <= AllocSize || Relocatable)
+		{
+			GrowFor(NewArraySize);
+			OpenGap(Index, Count);
+			return;
+		}
+		unsigned int NewAllocSize = NewArraySize * 2;
+		EspType* NewArrayData = (EspType*)::malloc(NewAllocSize * sizeof(EspType));
+		if (NewArrayData == NULL)
+			throw("Allocate Buffer Unsuccessfully!");
+		for (unsigned int TimeNum = 0; TimeNum < ArraySize; TimeNum++)
 		{
-			ArrayData = (EspType*)::malloc(NewArray.GetCount() * sizeof(EspType));
-			for (unsigned int TimeNum = 0; TimeNum < NewArray.GetCount(); TimeNum++)
-				::new(ArrayData + TimeNum)EspType;
-			//::memcpy(ArrayData, &NewElement, sizeof(EspType));
-			for (unsigned int TimeNum = 0; TimeNum < NewArray.GetCount(); TimeNum++)
-				ArrayData[TimeNum] = NewArray.GetElementAt(TimeNum);
-			ArraySize = NewArray.GetCount();
-			AllocSize = NewArray.GetCount();
+			::new(NewArrayData + (TimeNum < Index ? TimeNum : TimeNum + Count))EspType(std::move(ArrayData[TimeNum]));
+			(ArrayData + TimeNum)->~EspType();
 		}
+		ReleaseBuffer();
+		ArrayData = NewArrayData;
+		AllocSize = NewAllocSize;
+	}
+	static void CopyConstruct(EspType* Dest, const EspType* Source, unsigned int Count)
+	{
+		if (std::is_trivially_copyable<EspType>::value)
+			::memcpy((void*)Dest, (const void*)Source, Count * sizeof(EspType));
 		else
+			for (unsigned int TimeNum = 0; TimeNum < Count; TimeNum++)
+				::new(Dest + TimeNum)EspType(Source[TimeNum]);
+	}
+	template<class IteratorType>
+	static void CopyConstruct(EspType* Dest, IteratorType Source, unsigned int Count)
+	{
+		for (unsigned int TimeNum = 0; TimeNum < Count; TimeNum++, ++Source)
+			::new(Dest + TimeNum)EspType(*Source);
+	}
+
+public:
+	EspArray()
+	{
+		ArrayData = this->GetInlineData();
+		ArraySize = 0;
+		AllocSize = InlineCount;
+	}
+	EspArray(const EspArray& NewArray)
+	{
+		ArrayData = this->GetInlineData();
+		ArraySize = 0;
+		AllocSize = InlineCount;
+		AddArray(NewArray);
+	}
+	EspArray(EspArray&& NewArray)
+	{
+		ArrayData = this->GetInlineData();
+		ArraySize = 0;
+		AllocSize = InlineCount;
+		*this = std::move(NewArray);
+	}
+	~EspArray()
+	{
+		for (unsigned int TimeNum = 0; TimeNum < ArraySize; TimeNum++)
+			(ArrayData + TimeNum)->~EspType();
+		ArraySize = 0;
+		ReleaseBuffer();
+	}
+	const EspArray& operator=(const EspArray& NewArray)
+	{
+		if (&NewArray != this)
 		{
-			unsigned int NewArraySize = ArraySize + NewArray.GetCount();
-			if (NewArraySize <= AllocSize)
+			Empty();
+			AddArray(NewArray);
+		}
+		return *this;
+	}
+	const EspArray& operator=(EspArray&& NewArray)
+	{
+		if (&NewArray != this)
+		{
+			Empty();
+			if (NewArray.IsInline())
 			{
-				for (unsigned int TimeNum = 0; TimeNum < NewArray.GetCount(); TimeNum++)
-				{
-					::new(ArrayData + ArraySize + TimeNum)EspType;
-					ArrayData[ArraySize + TimeNum] = NewArray.GetElementAt(TimeNum);
-				}
-				ArraySize = NewArraySize;
+				Reserve(NewArray.ArraySize);
+				NewArray.RelocateTo(ArrayData);
+				ArraySize = NewArray.ArraySize;
+				NewArray.ArraySize = 0;
 			}
 			else
 			{
-				unsigned int NewAllocSize = NewArraySize * 2;
-				EspType* NewArrayData = (EspType*)::malloc(NewAllocSize * sizeof(EspType));
-				if (NewArrayData == NULL)
-					throw("Allocate Buffer Unsuccessfully!");
-				::memcpy(NewArrayData, ArrayData, ArraySize * sizeof(EspType));
-				for (unsigned int TimeNum = 0; TimeNum < NewArray.GetCount(); TimeNum++)
-				{
-					::new(NewArrayData + ArraySize + TimeNum)EspType;
-					NewArrayData[ArraySize + TimeNum] = NewArray.GetElementAt(TimeNum);
-				}
-				::memset(NewArrayData + NewArraySize, 0, (NewAllocSize - NewArraySize) * sizeof(EspType));
-				::free(ArrayData);
-				ArrayData = NewArrayData;
-				ArraySize = NewArraySize;
-				AllocSize = NewAllocSize;
+				ReleaseBuffer();
+				ArrayData = NewArray.ArrayData;
+				ArraySize = NewArray.ArraySize;
+				AllocSize = NewArray.AllocSize;
+				NewArray.ArrayData = NewArray.GetInlineData();
+				NewArray.ArraySize = 0;
+				NewArray.AllocSize = InlineCount;
 			}
 		}
+		return *this;
+	}
+
+	void Reserve(unsigned int NewAllocSize)
+	{
+		if (NewAllocSize > AllocSize)
+			Reallocate(NewAllocSize);
+	}
+	void Resize(unsigned int NewArraySize)
+	{
+		if (NewArraySize > ArraySize)
+		{
+			Reserve(NewArraySize);
+			for (unsigned int TimeNum = ArraySize; TimeNum < NewArraySize; TimeNum++)
+				::new(ArrayData + TimeNum)EspType();
+		}
+		else
+			for (unsigned int TimeNum = NewArraySize; TimeNum < ArraySize; TimeNum++)
+				(ArrayData + TimeNum)->~EspType();
+		ArraySize = NewArraySize;
+	}
+	void ShrinkToFit()
+	{
+		if (IsInline() || ArraySize == AllocSize)
+			return;
+		if (ArraySize <= InlineCount)
+		{
+			EspType* OldArrayData = ArrayData;
+			RelocateTo(this->GetInlineData());
+			ArrayData = OldArrayData;
+			ReleaseBuffer();
+		}
+		else
+			Reallocate(ArraySize);
+	}
+
+	template<class... ArgTypes>
+	EspType& Emplace(ArgTypes&&... Args)
+	{
+		if (ArraySize == AllocSize)
+		{
+			//Arguments may refer into the buffer that is about to move
+			EspType NewElement(std::forward<ArgTypes>(Args)...);
+			GrowFor(ArraySize + 1);
+			::new(ArrayData + ArraySize)EspType(std::move(NewElement));
+		}
+		else
+			::new(ArrayData + ArraySize)EspType(std::forward<ArgTypes>(Args)...);
+		return ArrayData[ArraySize++];
+	}
+	void AddElement(const EspType& NewElement) { Emplace(NewElement); }
+	void AddElement(EspType&& NewElement) { Emplace(std::move(NewElement)); }
+	void AddArray(const EspArray& NewArray)
+	{
+		unsigned int NewCount = NewArray.ArraySize;
+		if (NewCount == 0)
+			return;
+		if (ArraySize == 0)
+			Reserve(NewCount);
+		else
+			GrowFor(ArraySize + NewCount);
+		EspArray::CopyConstruct(ArrayData + ArraySize, (const EspType*)NewArray.ArrayData, NewCount);
+		ArraySize += NewCount;
 	}
 
 	void DeleteElement(unsigned int Index, unsigned int Count = 1)
@@ -119,88 +599,107 @@ public:
 		if (ArrayData != NULL)
 		{
 			assert(Index < ArraySize);
-			unsigned int NewArraySize = ArraySize - Count;
 			for (unsigned int TimeNum = 0; TimeNum < Count; TimeNum++)
 				(ArrayData + Index + TimeNum)->~EspType();
-			::memcpy(ArrayData + Index, ArrayData + Index + Count, (ArraySize - Index - Count) * sizeof(EspType));
-			ArraySize = NewArraySize;
-			::memset(ArrayData + NewArraySize, 0, sizeof(EspType));
+			CloseGap(Index, Count);
+			ArraySize -= Count;
 		}
 	}
-
-	void InsertElementAt(unsigned int Index, const EspType& NewElement, unsigned int Count = 1)
+	void EraseRange(unsigned int First, unsigned int Last)
 	{
-		if (ArrayData != NULL)
+		assert(First <= Last && Last <= ArraySize);
+		if (First < Last)
+			DeleteElement(First, Last - First);
+	}
+	//Stable single-pass compaction; returns the number of removed elements
+	template<class PredicateType>
+	unsigned int RemoveIf(PredicateType Pred)
+	{
+		unsigned int WritePos = 0;
+		for (unsigned int ReadPos = 0; ReadPos < ArraySize; ReadPos++)
 		{
-			assert(Index < ArraySize);
-			unsigned int NewArraySize = ArraySize + Count;
-			if (NewArraySize <= AllocSize)
+			if (Pred(ArrayData[ReadPos]))
 			{
-				::memcpy(ArrayData + Index + Count, ArrayData + Index, (ArraySize - Index) * sizeof(EspType));
-				for (unsigned int TimeNum = 0; TimeNum < Count; TimeNum++)
-				{
-					::new(ArrayData + Index + TimeNum)EspType;
-					ArrayData[Index + TimeNum] = NewElement;
-				}
-				ArraySize = NewArraySize;
+				(ArrayData + ReadPos)->~EspType();
+				continue;
 			}
-			else
+			if (WritePos != ReadPos)
 			{
-				unsigned int NewAllocSize = NewArraySize * 2;
-				EspType* NewArrayData = (EspType*)::malloc(NewAllocSize * sizeof(EspType));
-				if (NewArrayData == NULL)
-					throw("Allocate Buffer Unsuccessfully!");
-				::memcpy(NewArrayData, ArrayData, (Index) * sizeof(EspType));
-				for (unsigned int TimeNum = 0; TimeNum < Count; TimeNum++)
+				if (Relocatable)
+					::memcpy((void*)(ArrayData + WritePos), (void*)(ArrayData + ReadPos), sizeof(EspType));
+				else
 				{
-					::new(NewArrayData + Index + TimeNum)EspType;
-					NewArrayData[Index + TimeNum] = NewElement;
+					::new(ArrayData + WritePos)EspType(std::move(ArrayData[ReadPos]));
+					(ArrayData + ReadPos)->~EspType();
 				}
-				::memcpy(NewArrayData + Index + Count, ArrayData + Index, (ArraySize - Index) * sizeof(EspType));
-				::memset(NewArrayData + NewArraySize, 0, (NewAllocSize - NewArraySize) * sizeof(EspType));
-				::free(ArrayData);
-				ArrayData = NewArrayData;
-				ArraySize = NewArraySize;
-				AllocSize = NewAllocSize;
 			}
+			WritePos++;
 		}
+		unsigned int Removed = ArraySize - WritePos;
+		ArraySize = WritePos;
+		return Removed;
 	}
-	void InsertArray(unsigned int Index, const EspArray<EspType>& NewArray)
+
+	void InsertElementAt(unsigned int Index, const EspType& NewElement, unsigned int Count = 1)
 	{
 		if (ArrayData != NULL)
 		{
 			assert(Index < ArraySize);
-			unsigned int NewArraySize = ArraySize + NewArray.GetCount();
-			if (NewArraySize <= AllocSize)
+			if (&NewElement >= ArrayData && &NewElement < ArrayData + ArraySize)
 			{
-				::memcpy(ArrayData + Index + NewArray.GetCount(), ArrayData + Index, (ArraySize - Index) * sizeof(EspType));
-				for (unsigned int TimeNum = 0; TimeNum < NewArray.GetCount(); TimeNum++)
-				{
-					::new(ArrayData + Index + TimeNum)EspType;
-					ArrayData[Index + TimeNum] = NewArray.GetElementAt(TimeNum);
-				}
-				ArraySize = NewArraySize;
-			}
-			else
-			{
-				unsigned int NewAllocSize = NewArraySize * 2;
-				EspType* NewArrayData = (EspType*)::malloc(NewAllocSize * sizeof(EspType));
-				if (NewArrayData == NULL)
-					throw("Allocate Buffer Unsuccessfully!");
-				::memcpy(NewArrayData, ArrayData, Index * sizeof(EspType));
-				for (unsigned int TimeNum = 0; TimeNum < NewArray.GetCount(); TimeNum++)
-				{
-					::new(NewArrayData + Index + TimeNum)EspType;
-					NewArrayData[Index + TimeNum] = NewArray.GetElementAt(TimeNum);
-				}
-				::memcpy(NewArrayData + Index + NewArray.GetCount(), ArrayData + Index, (ArraySize - Index) * sizeof(EspType));
-				::memset(NewArrayData + NewArraySize, 0, (NewAllocSize - NewArraySize) * sizeof(EspType));
-				::free(ArrayData);
-				ArrayData = NewArrayData;
-				ArraySize = NewArraySize;
-				AllocSize = NewAllocSize;
+				EspType Element(NewElement);
+				InsertElementAt(Index, Element, Count);
+				return;
 			}
+			MakeRoom(Index, Count);
+			for (unsigned int TimeNum = 0; TimeNum < Count; TimeNum++)
+				::new(ArrayData + Index + TimeNum)EspType(NewElement);
+			ArraySize += Count;
+		}
+	}
+	void InsertArray(unsigned int Index, const EspArray& NewArray)
+	{
+		if (ArrayData != NULL)
+		{
+			assert(Index < ArraySize);
+			InsertRange(Index, NewArray);
+		}
+	}
+	void InsertRange(unsigned int Index, const EspArray& NewArray)
+	{
+		if (&NewArray == this)
+		{
+			EspArray Copy(NewArray);
+			InsertRange(Index, Copy.ArrayData, Copy.ArrayData + Copy.ArraySize);
+		}
+		else
+			InsertRange(Index, NewArray.ArrayData, NewArray.ArrayData + NewArray.ArraySize);
+	}
+	void InsertRange(unsigned int Index, const EspType* First, const EspType* Last)
+	{
+		assert(Index <= ArraySize && First <= Last);
+		if (First >= ArrayData && First < ArrayData + ArraySize)
+		{
+			EspArray Copy;
+			Copy.Reserve(Last - First);
+			Copy.InsertRange(0, First, Last);
+			InsertRange(Index, Copy.ArrayData, Copy.ArrayData + Copy.ArraySize);
+			return;
 		}
+		unsigned int NewCount = Last - First;
+		MakeRoom(Index, NewCount);
+		EspArray::CopyConstruct(ArrayData + Index, First, NewCount);
+		ArraySize += NewCount;
+	}
+	void InsertRange(unsigned int Index, EspType* First, EspType* Last) { InsertRange(Index, (const EspType*)First, (const EspType*)Last); }
+	template<class IteratorType>
+	void InsertRange(unsigned int Index, IteratorType First, IteratorType Last)
+	{
+		assert(Index <= ArraySize);
+		unsigned int NewCount = (unsigned int)std::distance(First, Last);
+		MakeRoom(Index, NewCount);
+		EspArray::CopyConstruct(ArrayData + Index, First, NewCount);
+		ArraySize += NewCount;
 	}
 
 	EspType& GetElementAt(unsigned int Index)const
@@ -213,6 +712,11 @@ public:
 		assert(Index < ArraySize);
 		ArrayData[Index] = NewElement;
 	}
+	void SetElementAt(unsigned int Index, EspType&& NewElement)
+	{
+		assert(Index < ArraySize);
+		ArrayData[Index] = std::move(NewElement);
+	}
 	unsigned int GetCount()const { return ArraySize; }
 	unsigned int GetBufSize()const { return AllocSize; }
 	unsigned int GetExtraSize()const { return AllocSize - ArraySize; }
@@ -221,6 +725,15 @@ public:
 	bool IsEmpty()const { return (ArraySize == 0); }
 	bool IsEmptyOrNull()const { return(ArraySize == 0 || ArrayData == NULL); }
 	bool IsFull()const { return (ArraySize == AllocSize); }
+	EspType* begin() { return ArrayData; }
+	EspType* end() { return ArrayData + ArraySize; }
+	const EspType* begin()const { return ArrayData; }
+	const EspType* end()const { return ArrayData + ArraySize; }
+
+	//Strings take the MSD radix path (see EspString.hpp); every other type uses pdqsort with operator<
+	void Sort(bool Parallel = false) { EspSortElements(ArrayData, ArraySize, Parallel); }
+	template<class CompareType>
+	void Sort(CompareType Comp, bool Parallel = false) { EspPdqSort<EspType, CompareType>::Sort(ArrayData, ArrayData + ArraySize, Comp, Parallel); }
 
 	void Empty()
 	{
@@ -232,3 +745,5 @@ public:
 		}
 	}
 };
+template<class EspType, unsigned int InlineCount = 8>
+using EspSmallArray = EspArray<EspType, InlineCount>;
\ No newline at end of file
@@ -0,0 +1,91 @@
+#pragma once
+#include<atomic>
+#include<memory>
+#include"EspString.hpp"
+#ifndef __ESPATOM__
+#define __ESPATOM__
+#endif
+struct EspAtomEntry
+{
+	EspAtomEntry* Next;
+	unsigned long long HashValue;
+	unsigned int Length;
+	char Data[1];
+};
+
+//Interned strings are never freed, so an EspAtom stays valid for the life of the process.
+//Lookups walk immutable bucket chains without locking; inserts publish new entries with a CAS on the bucket head.
+class EspAtom
+{
+private:
+	static const unsigned int BucketCount = 1 << 16;
+	const EspAtomEntry* Entry = nullptr;
+
+	EspAtom(const EspAtomEntry* Entry) :Entry(Entry) {}
+	static std::atomic<EspAtomEntry*>* GetBuckets()
+	{
+		static std::atomic<EspAtomEntry*> Buckets[BucketCount];
+		return Buckets;
+	}
+	static const EspAtomEntry* FindEntry(const EspAtomEntry* Head, const EspAtomEntry* Stop, const char* lpszStr, unsigned int nLength, unsigned long long HashValue)
+	{
+		for (const EspAtomEntry* Pos = Head; Pos != Stop; Pos = Pos->Next)
+			if (Pos->HashValue == HashValue && Pos->Length == nLength && (nLength == 0 || ::memcmp(Pos->Data, lpszStr, nLength) == 0))
+				return Pos;
+		return NULL;
+	}
+
+public:
+	EspAtom() {}
+
+	static EspAtom Find(const char* lpszStr, unsigned int nLength)
+	{
+		unsigned long long HashValue = EspString::Hash(lpszStr, nLength);
+		std::atomic<EspAtomEntry*>& Bucket = EspAtom::GetBuckets()[HashValue & (BucketCount - 1)];
+		return EspAtom(EspAtom::FindEntry(Bucket.load(std::memory_order_acquire), NULL, lpszStr, nLength, HashValue));
+	}
+	static EspAtom Find(const EspString& lpszStr) { return EspAtom::Find(lpszStr.GetAnsiStr(), lpszStr.GetLength()); }
+	static EspAtom Intern(const char* lpszStr, unsigned int nLength)
+	{
+		unsigned long long HashValue = EspString::Hash(lpszStr, nLength);
+		std::atomic<EspAtomEntry*>& Bucket = EspAtom::GetBuckets()[HashValue & (BucketCount - 1)];
+		EspAtomEntry* Head = Bucket.load(std::memory_order_acquire);
+		const EspAtomEntry* Found = EspAtom::FindEntry(Head, NULL, lpszStr, nLength, HashValue);
+		if (Found != NULL)
+			return EspAtom(Found);
+		EspAtomEntry* NewEntry = (EspAtomEntry*)::malloc(sizeof(EspAtomEntry) + nLength);
+		if (NewEntry == NULL)
+			throw("Allocate Buffer Unsuccessfully!");
+		NewEntry->HashValue = HashValue;
+		NewEntry->Length = nLength;
+		if (nLength > 0)
+			::memcpy(NewEntry->Data, lpszStr, nLength);
+		NewEntry->Data[nLength] = '\0';
+		NewEntry->Next = Head;
+		EspAtomEntry* Scanned = Head;
+		while (!Bucket.compare_exchange_weak(NewEntry->Next, NewEntry, std::memory_order_release, std::memory_order_acquire))
+		{
+			//Only entries published since the last scan can be duplicates
+			Found = EspAtom::FindEntry(NewEntry->Next, Scanned, lpszStr, nLength, HashValue);
+			if (Found != NULL)
+			{
+				::free(NewEntry);
+				return EspAtom(Found);
+			}
+			Scanned = NewEntry->Next;
+		}
+		return EspAtom(NewEntry);
+	}
+	static EspAtom Intern(const EspString& lpszStr) { return EspAtom::Intern(lpszStr.GetAnsiStr(), lpszStr.GetLength()); }
+	static EspAtom Intern(const char* lpszStr) { return EspAtom::Intern(lpszStr, EspString::GetLength(lpszStr)); }
+
+	bool IsNull()const { return Entry == NULL; }
+	const char* GetAnsiStr()const { return Entry != NULL ? Entry->Data : NULL; }
+	operator const char* ()const { return GetAnsiStr(); }
+	unsigned int GetLength()const { return Entry != NULL ? Entry->Length : 0; }
+	unsigned long long GetHash()const { return Entry != NULL ? Entry->HashValue : 0; }
+	EspString ToString()const { return EspString(GetAnsiStr()); }
+
+	bool operator==(const EspAtom& Atom)const { return Entry == Atom.Entry; }
+	bool operator!=(const EspAtom& Atom)const { return Entry != Atom.Entry; }
+};
@@ -0,0 +1,312 @@
+#pragma once
+#include<assert.h>
+#include<math.h>
+#include"EspString.hpp"
+#include"EspArray.hpp"
+#include"EspHashMap.hpp"
+#include"EspJsonParser.hpp"
+#ifndef __ESPCOLUMNAR__
+#define __ESPCOLUMNAR__
+#endif
+//Column_Null means no value has been seen yet; Int64 is promoted to Double on the first fractional number and
+//any other type conflict, or a nested object/array, turns the column into Mixed, which keeps plain EspJsonValue copies
+enum class EspColumnType { Column_Null, Column_Boolean, Column_Int64, Column_Double, Column_String, Column_Mixed };
+
+//One field across all records: a dense typed array plus a validity bitmap (bit set = value present and not null).
+//Null rows still occupy a slot holding 0, false or "" so that row i is always at index i.
+class EspColumn
+{
+private:
+	EspString Name;
+	EspColumnType ColumnType = EspColumnType::Column_Null;
+	unsigned int RowCount = 0;
+	unsigned int NullCount = 0;
+	EspArray<unsigned long long> Validity;
+	EspArray<unsigned char> Booleans;
+	EspArray<long long> Int64s;
+	EspArray<double> Doubles;
+	EspArray<char> StringData;
+	EspArray<unsigned int> StringOffsets;
+	EspArray<EspJsonValue> Mixed;
+
+	static bool IsInt64(double Value) { return Value == ::floor(Value) && Value >= -9007199254740992.0 && Value <= 9007199254740992.0; }
+	static EspColumnType GetColumnType(const EspJsonValue& Value)
+	{
+		switch (Value.GetValueType())
+		{
+		case EspJsonValueType::Value_Boolean:return EspColumnType::Column_Boolean;
+		case EspJsonValueType::Value_Number:return EspColumn::IsInt64(Value.GetNumber()) ? EspColumnType::Column_Int64 : EspColumnType::Column_Double;
+		case EspJsonValueType::Value_String:return EspColumnType::Column_String;
+		default:return EspColumnType::Column_Mixed;
+		}
+	}
+	void SetValid(unsigned int Row)
+	{
+		Validity.GetElementAt(Row >> 6) |= 1ull << (Row & 63);
+	}
+	void AddPlaceholder()
+	{
+		switch (ColumnType)
+		{
+		case EspColumnType::Column_Boolean:Booleans.AddElement(0); break;
+		case EspColumnType::Column_Int64:Int64s.AddElement(0); break;
+		case EspColumnType::Column_Double:Doubles.AddElement(0.0); break;
+		case EspColumnType::Column_String:StringOffsets.AddElement(StringData.GetCount()); break;
+		case EspColumnType::Column_Mixed:Mixed.AddElement(EspJsonValue(EspJsonValueType::Value_Null, nullptr)); break;
+		default:break;
+		}
+	}
+	void AddRow()
+	{
+		if ((RowCount & 63) == 0)
+			Validity.AddElement(0);
+		RowCount++;
+	}
+	EspJsonValue GetJsonValue(unsigned int Row)const
+	{
+		if (!IsValid(Row))
+			return EspJsonValue(EspJsonValueType::Value_Null, nullptr);
+		switch (ColumnType)
+		{
+		case EspColumnType::Column_Boolean:return EspJsonValue(GetBoolean(Row));
+		case EspColumnType::Column_Int64:return EspJsonValue((double)GetInt64(Row));
+		case EspColumnType::Column_Double:return EspJsonValue(GetDouble(Row));
+		case EspColumnType::Column_String:return EspJsonValue(GetString(Row));
+		case EspColumnType::Column_Mixed:return Mixed.GetElementAt(Row);
+		default:return EspJsonValue(EspJsonValueType::Value_Null, nullptr);
+		}
+	}
+	//Rebuilds the existing rows under NewType; only Null -> anything, Int64 -> Double and anything -> Mixed are requested
+	void ChangeType(EspColumnType NewType)
+	{
+		if (NewType == EspColumnType::Column_Mixed)
+		{
+			Mixed.Reserve(RowCount);
+			for (unsigned int Row = 0; Row < RowCount; Row++)
+				Mixed.AddElement(GetJsonValue(Row));
+			Booleans.Empty();
+			Int64s.Empty();
+			Doubles.Empty();
+			StringData.Empty();
+			StringOffsets.Empty();
+			ColumnType = NewType;
+			return;
+		}
+		if (ColumnType == EspColumnType::Column_Int64)
+		{
+			Doubles.Reserve(RowCount);
+			for (unsigned int Row = 0; Row < RowCount; Row++)
+				Doubles.AddElement((double)Int64s.GetElementAt(Row));
+			Int64s.Empty();
+			ColumnType = NewType;
+			return;
+		}
+		ColumnType = NewType;
+		if (NewType == EspColumnType::Column_String)
+			StringOffsets.AddElement(0);
+		for (unsigned int Row = 0; Row < RowCount; Row++)
+			AddPlaceholder();
+	}
+
+public:
+	EspColumn() {}
+	EspColumn(const EspString& Name) :Name(Name) {}
+
+	void AddNull()
+	{
+		AddPlaceholder();
+		AddRow();
+		NullCount++;
+	}
+	void AddValue(const EspJsonValue& Value)
+	{
+		if (Value.IsNull() || Value.IsVoid())
+		{
+			AddNull();
+			return;
+		}
+		EspColumnType ValueType = EspColumn::GetColumnType(Value);
+		if (ValueType != ColumnType && ColumnType != EspColumnType::Column_Mixed)
+		{
+			if (ColumnType == EspColumnType::Column_Null)
+				ChangeType(ValueType);
+			else if (ColumnType == EspColumnType::Column_Int64 && ValueType == EspColumnType::Column_Double)
+				ChangeType(EspColumnType::Column_Double);
+			else if (!(ColumnType == EspColumnType::Column_Double && ValueType == EspColumnType::Column_Int64))
+				ChangeType(EspColumnType::Column_Mixed);
+		}
+		switch (ColumnType)
+		{
+		case EspColumnType::Column_Boolean:Booleans.AddElement(Value.GetBoolean() ? 1 : 0); break;
+		case EspColumnType::Column_Int64:Int64s.AddElement((long long)Value.GetNumber()); break;
+		case EspColumnType::Column_Double:Doubles.AddElement(Value.GetNumber()); break;
+		case EspColumnType::Column_String:
+		{
+			const EspString& String = Value.GetString();
+			StringData.InsertRange(StringData.GetCount(), String.GetAnsiStr(), String.GetAnsiStr() + String.GetLength());
+			StringOffsets.AddElement(StringData.GetCount());
+			break;
+		}
+		default:Mixed.AddElement(Value); break;
+		}
+		AddRow();
+		SetValid(RowCount - 1);
+	}
+
+	const EspString& GetName()const { return Name; }
+	EspColumnType GetColumnType()const { return ColumnType; }
+	unsigned int GetRowCount()const { return RowCount; }
+	unsigned int GetNullCount()const { return NullCount; }
+	bool IsValid(unsigned int Row)const
+	{
+		assert(Row < RowCount);
+		return (Validity.GetElementAt(Row >> 6) >> (Row & 63)) & 1;
+	}
+
+	//Dense column buffers, RowCount entries long (StringOffsets has RowCount + 1); row i of a string column is
+	//StringData[StringOffsets[i], StringOffsets[i + 1])
+	const unsigned long long* GetValidityBitmap()const { return Validity.GetBuffer(); }
+	const unsigned char* GetBooleans()const { return Booleans.GetBuffer(); }
+	const long long* GetInt64s()const { return Int64s.GetBuffer(); }
+	const double* GetDoubles()const { return Doubles.GetBuffer(); }
+	const char* GetStringData()const { return StringData.GetBuffer(); }
+	const unsigned int* GetStringOffsets()const { return StringOffsets.GetBuffer(); }
+	const EspJsonValue* GetMixed()const { return Mixed.GetBuffer(); }
+
+	bool GetBoolean(unsigned int Row)const { return Booleans.GetElementAt(Row) != 0; }
+	long long GetInt64(unsigned int Row)const { return Int64s.GetElementAt(Row); }
+	double GetDouble(unsigned int Row)const { return ColumnType == EspColumnType::Column_Int64 ? (double)Int64s.GetElementAt(Row) : Doubles.GetElementAt(Row); }
+	unsigned int GetStringLength(unsigned int Row)const { return StringOffsets.GetElementAt(Row + 1) - StringOffsets.GetElementAt(Row); }
+	const char* GetStringData(unsigned int Row)const { return StringData.GetBuffer() + StringOffsets.GetElementAt(Row); }
+	EspString GetString(unsigned int Row)const
+	{
+		EspString Result;
+		unsigned int Length = GetStringLength(Row);
+		if (Length > 0)
+			::memcpy(Result.GetBufferSetLength(Length), GetStringData(Row), Length);
+		return Result;
+	}
+
+	//Sum of the non-null rows of a numeric column; null rows hold 0, so the dense loop needs no bitmap test
+	double Sum()const
+	{
+		double Total = 0;
+		if (ColumnType == EspColumnType::Column_Int64)
+		{
+			long long IntTotal = 0;
+			const long long* Data = Int64s.GetBuffer();
+			for (unsigned int Row = 0; Row < RowCount; Row++)
+				IntTotal += Data[Row];
+			Total = (double)IntTotal;
+		}
+		else if (ColumnType == EspColumnType::Column_Double)
+		{
+			const double* Data = Doubles.GetBuffer();
+			for (unsigned int Row = 0; Row < RowCount; Row++)
+				Total += Data[Row];
+		}
+		return Total;
+	}
+	//Sets bit i of Selection (RowCount bits, resized as needed) for every non-null row where Pred(value) holds
+	template<class PredicateType>
+	void Filter(PredicateType Pred, EspArray<unsigned long long>& Selection)const
+	{
+		Selection.Resize((RowCount + 63) / 64);
+		for (unsigned int Word = 0; Word < Selection.GetCount(); Word++)
+		{
+			unsigned long long Bits = 0;
+			unsigned int End = RowCount - Word * 64 < 64 ? RowCount - Word * 64 : 64;
+			for (unsigned int Bit = 0; Bit < End; Bit++)
+			{
+				unsigned int Row = Word * 64 + Bit;
+				bool Matched;
+				switch (ColumnType)
+				{
+				case EspColumnType::Column_Boolean:Matched = Pred(GetBoolean(Row)); break;
+				case EspColumnType::Column_Int64:Matched = Pred(Int64s.GetBuffer()[Row]); break;
+				case EspColumnType::Column_Double:Matched = Pred(Doubles.GetBuffer()[Row]); break;
+				default:Matched = false; break;
+				}
+				Bits |= (unsigned long long)Matched << Bit;
+			}
+			Selection.GetElementAt(Word) = Bits & Validity.GetElementAt(Word);
+		}
+	}
+};
+
+//Turns uniform JSON records into one EspColumn per key. Records may arrive one at a time; a key first seen late is
+//back-filled with nulls, and a key missing from a record gets a null in that row.
+class EspColumnar
+{
+private:
+	EspArray<EspColumn> Columns;
+	EspHashMap<EspString, unsigned int> ColumnIndex;
+	unsigned int RowCount = 0;
+
+	unsigned int GetColumnIndex(const EspString& Key, unsigned int Position)
+	{
+		//Records usually repeat the same key order, so try the column at the member's position first
+		if (Position < Columns.GetCount() && Columns.GetElementAt(Position).GetName().GetLength() == Key.GetLength() && Columns.GetElementAt(Position).GetName().Compare(Key))
+			return Position;
+		unsigned int* Found = ColumnIndex.Find(Key);
+		if (Found != NULL)
+			return *Found;
+		EspColumn& NewColumn = Columns.Emplace(Key);
+		for (unsigned int Row = 0; Row < RowCount; Row++)
+			NewColumn.AddNull();
+		ColumnIndex.SetValue(Key, Columns.GetCount() - 1);
+		return Columns.GetCount() - 1;
+	}
+
+public:
+	EspColumnar() {}
+	EspColumnar(const EspJsonArray& JsonArray) { AddRecords(JsonArray); }
+
+	void AddRecord(const EspJsonObject& JsonObject)
+	{
+		for (unsigned int TimeNum = 0; TimeNum < JsonObject.GetCount(); TimeNum++)
+		{
+			const EspJsonMember& Member = JsonObject.GetMember(TimeNum);
+			EspColumn& Column = Columns.GetElementAt(GetColumnIndex(Member.GetKey(), TimeNum));
+			//A duplicate key keeps its first value
+			if (Column.GetRowCount() == RowCount)
+				Column.AddValue(Member.GetValue());
+		}
+		RowCount++;
+		for (unsigned int TimeNum = 0; TimeNum < Columns.GetCount(); TimeNum++)
+			if (Columns.GetElementAt(TimeNum).GetRowCount() < RowCount)
+				Columns.GetElementAt(TimeNum).AddNull();
+	}
+	//Every element becomes a row; elements that are not objects give an all-null row
+	void AddRecords(const EspJsonArray& JsonArray)
+	{
+		for (unsigned int TimeNum = 0; TimeNum < JsonArray.GetCount(); TimeNum++)
+		{
+			const EspJsonValue& Value = JsonArray.GetValue(TimeNum);
+			if (Value.IsObject())
+				AddRecord(Value.GetJsonObject());
+			else
+			{
+				RowCount++;
+				for (unsigned int Column = 0; Column < Columns.GetCount(); Column++)
+					Columns.GetElementAt(Column).AddNull();
+			}
+		}
+	}
+
+	unsigned int GetRowCount()const { return RowCount; }
+	unsigned int GetColumnCount()const { return Columns.GetCount(); }
+	//References stay valid until a record introduces a new key
+	EspColumn& GetColumn(unsigned int Index) { return Columns.GetElementAt(Index); }
+	EspColumn* FindColumn(const EspString& Name)
+	{
+		unsigned int* Found = ColumnIndex.Find(Name);
+		return Found != NULL ? &Columns.GetElementAt(*Found) : NULL;
+	}
+	void Empty()
+	{
+		Columns.Empty();
+		ColumnIndex.Empty();
+		RowCount = 0;
+	}
+};
@@ -0,0 +1,202 @@
+#pragma once
+#include<assert.h>
+#include<atomic>
+#include<memory>
+#include<new>
+#include"EspArray.hpp"
+#include"EspSegmentedArray.hpp"
+#ifndef __ESPCONCURRENTARRAY__
+#define __ESPCONCURRENTARRAY__
+#endif
+
+//Append reserves an index with one fetch_add on the cursor and constructs the element in a segmented block that never moves,
+//so producers never wait for each other. A per-slot ready flag marks finished elements; consumers only see the ready prefix.
+//A constructor that throws marks its slot failed instead, so the prefix still advances past it and nothing reads or destroys it.
+//Indexes are never reused while appends are running: Drain destroys elements and frees fully drained blocks, Reset starts over.
+template<class EspType, unsigned int FirstBlockShift = 8>
+class EspConcurrentArray
+{
+private:
+	typedef EspSegmentLayout<FirstBlockShift> Layout;
+	static const unsigned int MaxBlockCount = Layout::MaxBlockCount;
+	static const unsigned char SlotPending = 0, SlotReady = 1, SlotFailed = 2;
+	//Marks a block that was drained and freed; no index inside it will be touched again
+	static EspType* GetFreedBlock()
+	{
+		static char Sentinel;
+		return (EspType*)(void*)&Sentinel;
+	}
+
+	std::atomic<EspType*> Blocks[MaxBlockCount];
+	std::atomic<unsigned int> Cursor{ 0 };
+	std::atomic<unsigned int> Published{ 0 };
+	unsigned int Drained = 0;
+
+	static std::atomic<unsigned char>* GetReadyFlags(EspType* Data, unsigned int Block)
+	{
+		return (std::atomic<unsigned char>*)(Data + Layout::GetBlockSize(Block));
+	}
+	EspType* GetBlock(unsigned int Block)
+	{
+		EspType* Data = Blocks[Block].load(std::memory_order_acquire);
+		if (Data != NULL)
+			return Data;
+		unsigned int Size = Layout::GetBlockSize(Block);
+		EspType* NewData = (EspType*)::malloc(Size * sizeof(EspType) + Size * sizeof(std::atomic<unsigned char>));
+		if (NewData == NULL)
+			throw("Allocate Buffer Unsuccessfully!");
+		std::atomic<unsigned char>* Ready = EspConcurrentArray::GetReadyFlags(NewData, Block);
+		for (unsigned int TimeNum = 0; TimeNum < Size; TimeNum++)
+			::new(Ready + TimeNum)std::atomic<unsigned char>(0);
+		if (Blocks[Block].compare_exchange_strong(Data, NewData, std::memory_order_acq_rel, std::memory_order_acquire))
+			return NewData;
+		//Another producer installed the block first
+		::free(NewData);
+		return Data;
+	}
+	unsigned char GetSlotState(unsigned int Index)const
+	{
+		unsigned int Block, Offset;
+		Layout::Locate(Index, Block, Offset);
+		EspType* Data = Blocks[Block].load(std::memory_order_acquire);
+		return Data != NULL ? EspConcurrentArray::GetReadyFlags(Data, Block)[Offset].load(std::memory_order_acquire) : SlotPending;
+	}
+	//Failed appends still bump the cursor, so readers clamp it to the indexes that can exist
+	unsigned int GetReservedLimit()const
+	{
+		unsigned int Reserved = Cursor.load(std::memory_order_acquire);
+		return Reserved < EspConcurrentArray::GetCapacity() ? Reserved : EspConcurrentArray::GetCapacity();
+	}
+	void FreeBlocks()
+	{
+		for (unsigned int Block = 0; Block < MaxBlockCount; Block++)
+		{
+			EspType* Data = Blocks[Block].load(std::memory_order_relaxed);
+			if (Data != NULL && Data != EspConcurrentArray::GetFreedBlock())
+				::free(Data);
+			Blocks[Block].store(NULL, std::memory_order_relaxed);
+		}
+	}
+
+public:
+	EspConcurrentArray()
+	{
+		for (unsigned int Block = 0; Block < MaxBlockCount; Block++)
+			Blocks[Block].store(NULL, std::memory_order_relaxed);
+	}
+	EspConcurrentArray(const EspConcurrentArray&) = delete;
+	const EspConcurrentArray& operator=(const EspConcurrentArray&) = delete;
+	~EspConcurrentArray()
+	{
+		Reset();
+	}
+
+	//Largest number of indexes that can be handed out
+	static unsigned int GetCapacity() { return Layout::GetBlockStart(MaxBlockCount - 1); }
+	//Safe from any number of threads; returns the index of the new element
+	template<class... ArgTypes>
+	unsigned int Emplace(ArgTypes&&... Args)
+	{
+		unsigned int Index = Cursor.fetch_add(1, std::memory_order_relaxed);
+		if (Index >= EspConcurrentArray::GetCapacity())
+			throw("Index Space Exhausted!");
+		unsigned int Block, Offset;
+		Layout::Locate(Index, Block, Offset);
+		EspType* Data = GetBlock(Block);
+		std::atomic<unsigned char>& State = EspConcurrentArray::GetReadyFlags(Data, Block)[Offset];
+		try
+		{
+			::new(Data + Offset)EspType(std::forward<ArgTypes>(Args)...);
+		}
+		catch (...)
+		{
+			State.store(SlotFailed, std::memory_order_release);
+			throw;
+		}
+		State.store(SlotReady, std::memory_order_release);
+		return Index;
+	}
+	unsigned int Append(const EspType& NewElement) { return Emplace(NewElement); }
+	unsigned int Append(EspType&& NewElement) { return Emplace(std::move(NewElement)); }
+
+	//Number of indexes handed out, including elements still being constructed and failed appends
+	unsigned int GetReservedCount()const { return GetReservedLimit(); }
+	//Length of the prefix whose slots are all finished; elements below it can be read while producers keep appending
+	unsigned int GetSnapshot()
+	{
+		unsigned int Count = Published.load(std::memory_order_acquire);
+		unsigned int Start = Count;
+		unsigned int Reserved = GetReservedLimit();
+		while (Count < Reserved && GetSlotState(Count) != SlotPending)
+			Count++;
+		while (Count > Start && !Published.compare_exchange_weak(Start, Count, std::memory_order_acq_rel))
+			if (Start >= Count)
+				return Start;
+		return Count;
+	}
+	//Valid for Drained <= Index < GetSnapshot() when IsConstructed(Index)
+	bool IsConstructed(unsigned int Index)const { return GetSlotState(Index) == SlotReady; }
+	EspType& GetElementAt(unsigned int Index)const
+	{
+		assert(Index >= Drained && Index < Published.load(std::memory_order_acquire) && IsConstructed(Index));
+		unsigned int Block, Offset;
+		Layout::Locate(Index, Block, Offset);
+		return Blocks[Block].load(std::memory_order_acquire)[Offset];
+	}
+	//Calls Func(Element) for every element of the current snapshot that has not been drained
+	template<class FuncType>
+	void ForEach(FuncType Func)
+	{
+		unsigned int Count = GetSnapshot();
+		for (unsigned int Index = Drained; Index < Count; Index++)
+			if (IsConstructed(Index))
+				Func(GetElementAt(Index));
+	}
+	//Moves every element of the current snapshot into Result; only one thread may drain at a time
+	template<unsigned int InlineCount>
+	unsigned int Drain(EspArray<EspType, InlineCount>& Result)
+	{
+		unsigned int Count = GetSnapshot();
+		unsigned int First = Drained;
+		Result.Reserve(Result.GetCount() + (Count - First));
+		unsigned int OldCount = Result.GetCount();
+		for (unsigned int Index = First; Index < Count; Index++)
+		{
+			if (!IsConstructed(Index))
+				continue;
+			EspType& Element = GetElementAt(Index);
+			Result.AddElement(std::move(Element));
+			Element.~EspType();
+		}
+		Drained = Count;
+		unsigned int Block, Offset;
+		if (Count > 0)
+		{
+			Layout::Locate(Count, Block, Offset);
+			for (unsigned int TimeNum = 0; TimeNum < Block; TimeNum++)
+			{
+				EspType* Data = Blocks[TimeNum].exchange(EspConcurrentArray::GetFreedBlock(), std::memory_order_acq_rel);
+				if (Data != EspConcurrentArray::GetFreedBlock())
+					::free(Data);
+			}
+		}
+		return Result.GetCount() - OldCount;
+	}
+	//Destroys everything and releases the storage; no producer may be running
+	void Reset()
+	{
+		unsigned int Count = GetReservedLimit();
+		for (unsigned int Index = Drained; Index < Count; Index++)
+		{
+			if (!IsConstructed(Index))
+				continue;
+			unsigned int Block, Offset;
+			Layout::Locate(Index, Block, Offset);
+			(Blocks[Block].load(std::memory_order_relaxed) + Offset)->~EspType();
+		}
+		FreeBlocks();
+		Cursor.store(0, std::memory_order_release);
+		Published.store(0, std::memory_order_release);
+		Drained = 0;
+	}
+};
@@ -0,0 +1,220 @@
+#pragma once
+#include<assert.h>
+#include<condition_variable>
+#include<mutex>
+#include<stdlib.h>
+#include<string.h>
+#include<thread>
+#if defined(_WIN32)
+#include<Windows.h>
+#else
+#include<fcntl.h>
+#include<unistd.h>
+#endif
+#include"EspString.hpp"
+#ifndef __ESPFILESINK__
+#define __ESPFILESINK__
+#endif
+
+enum class EspFsyncPolicy { Fsync_Never, Fsync_OnClose, Fsync_EveryBuffer };
+
+//Buffered file output with two buffers: Append fills one while a background thread writes the other, so producing
+//the data and the disk I/O overlap and memory stays at two buffers whatever the output size.
+//Has the Append overloads EspJsonWriter expects, e.g. EspJsonWriter::WriteObject(JsonObject, Sink) streams a document to disk.
+//Append, Flush and Close must be called from one thread.
+class EspAsyncFileSink
+{
+private:
+	char* Buffers[2] = { nullptr, nullptr };
+	unsigned int BufferSize;
+	EspFsyncPolicy FsyncPolicy;
+	char* Active = nullptr;
+	unsigned int ActiveLength = 0;
+#if defined(_WIN32)
+	HANDLE FileHandle = INVALID_HANDLE_VALUE;
+#else
+	int FileHandle = -1;
+#endif
+
+	//Hand-off to the writer thread: Pending is the buffer it owns until it sets Pending back to NULL
+	std::mutex Lock;
+	std::condition_variable Changed;
+	const char* Pending = nullptr;
+	unsigned int PendingLength = 0;
+	bool Stopping = false;
+	bool Failed = false;
+	std::thread Writer;
+
+	bool WriteAll(const char* Data, unsigned int Length)
+	{
+		while (Length > 0)
+		{
+#if defined(_WIN32)
+			DWORD Written;
+			if (!::WriteFile(FileHandle, Data, Length, &Written, NULL) || Written == 0)
+				return false;
+#else
+			ssize_t Written = ::write(FileHandle, Data, Length);
+			if (Written <= 0)
+				return false;
+#endif
+			Data += Written;
+			Length -= (unsigned int)Written;
+		}
+		return true;
+	}
+	bool Sync()
+	{
+#if defined(_WIN32)
+		return ::FlushFileBuffers(FileHandle) != 0;
+#else
+		return ::fsync(FileHandle) == 0;
+#endif
+	}
+	void WriterLoop()
+	{
+		std::unique_lock<std::mutex> Guard(Lock);
+		while (true)
+		{
+			Changed.wait(Guard, [this] { return Pending != NULL || Stopping; });
+			if (Pending == NULL)
+				return;
+			const char* Data = Pending;
+			unsigned int Length = PendingLength;
+			Guard.unlock();
+			bool Succeeded = WriteAll(Data, Length) && (FsyncPolicy != EspFsyncPolicy::Fsync_EveryBuffer || Sync());
+			Guard.lock();
+			if (!Succeeded)
+				Failed = true;
+			Pending = NULL;
+			Changed.notify_all();
+		}
+	}
+	//Waits until the writer is done with the other buffer, hands it the active one and switches
+	void Submit()
+	{
+		if (ActiveLength == 0)
+			return;
+		std::unique_lock<std::mutex> Guard(Lock);
+		Changed.wait(Guard, [this] { return Pending == NULL; });
+		Pending = Active;
+		PendingLength = ActiveLength;
+		Changed.notify_all();
+		Active = Active == Buffers[0] ? Buffers[1] : Buffers[0];
+		ActiveLength = 0;
+	}
+	void WaitIdle()
+	{
+		std::unique_lock<std::mutex> Guard(Lock);
+		Changed.wait(Guard, [this] { return Pending == NULL; });
+	}
+
+public:
+	EspAsyncFileSink(unsigned int nBufferSize = 1 << 20, EspFsyncPolicy nFsyncPolicy = EspFsyncPolicy::Fsync_OnClose)
+		:BufferSize(nBufferSize > 0 ? nBufferSize : 1), FsyncPolicy(nFsyncPolicy)
+	{
+	}
+	EspAsyncFileSink(const EspAsyncFileSink&) = delete;
+	const EspAsyncFileSink& operator=(const EspAsyncFileSink&) = delete;
+	~EspAsyncFileSink()
+	{
+		Close();
+		::free(Buffers[0]);
+		::free(Buffers[1]);
+	}
+
+	//Creates or truncates the file and starts the writer thread
+	bool Open(const char* lpszFileName)
+	{
+		Close();
+		if (Buffers[0] == NULL)
+		{
+			Buffers[0] = (char*)::malloc(BufferSize);
+			Buffers[1] = (char*)::malloc(BufferSize);
+			if (Buffers[0] == NULL || Buffers[1] == NULL)
+				throw("Allocate Buffer Unsuccessfully!");
+		}
+#if defined(_WIN32)
+		FileHandle = ::CreateFileA(lpszFileName, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (FileHandle == INVALID_HANDLE_VALUE)
+			return false;
+#else
+		FileHandle = ::open(lpszFileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (FileHandle < 0)
+			return false;
+#endif
+		Active = Buffers[0];
+		ActiveLength = 0;
+		Pending = NULL;
+		Stopping = false;
+		Failed = false;
+		Writer = std::thread(&EspAsyncFileSink::WriterLoop, this);
+		return true;
+	}
+	bool IsOpen()const { return Writer.joinable(); }
+
+	void Append(const char* lpszData, unsigned int nLength)
+	{
+		assert(IsOpen());
+		while (nLength > 0)
+		{
+			unsigned int Count = BufferSize - ActiveLength < nLength ? BufferSize - ActiveLength : nLength;
+			::memcpy(Active + ActiveLength, lpszData, Count);
+			ActiveLength += Count;
+			lpszData += Count;
+			nLength -= Count;
+			if (ActiveLength == BufferSize)
+				Submit();
+		}
+	}
+	void Append(const char& lpszChar)
+	{
+		assert(IsOpen());
+		Active[ActiveLength++] = lpszChar;
+		if (ActiveLength == BufferSize)
+			Submit();
+	}
+	void Append(const char* lpszStr) { Append(lpszStr, EspString::GetLength(lpszStr)); }
+	void Append(const EspString& lpszStr) { Append(lpszStr.GetAnsiStr(), lpszStr.GetLength()); }
+
+	//Blocks until everything appended so far has been handed to the OS; returns false if any write failed
+	bool Flush()
+	{
+		if (!IsOpen())
+			return false;
+		Submit();
+		WaitIdle();
+		std::lock_guard<std::mutex> Guard(Lock);
+		return !Failed;
+	}
+	//Flushes, syncs unless the policy is Fsync_Never, stops the writer thread and closes the file
+	bool Close()
+	{
+		if (!IsOpen())
+			return false;
+		bool Succeeded = Flush();
+		{
+			std::lock_guard<std::mutex> Guard(Lock);
+			Stopping = true;
+		}
+		Changed.notify_all();
+		Writer.join();
+		if (Succeeded && FsyncPolicy != EspFsyncPolicy::Fsync_Never)
+			Succeeded = Sync();
+#if defined(_WIN32)
+		::CloseHandle(FileHandle);
+		FileHandle = INVALID_HANDLE_VALUE;
+#else
+		::close(FileHandle);
+		FileHandle = -1;
+#endif
+		return Succeeded;
+	}
+	bool HasFailed()
+	{
+		std::lock_guard<std::mutex> Guard(Lock);
+		return Failed;
+	}
+	unsigned int GetBufferSize()const { return BufferSize; }
+	EspFsyncPolicy GetFsyncPolicy()const { return FsyncPolicy; }
+};
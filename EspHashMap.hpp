@@ -0,0 +1,306 @@
+#pragma once
+#include<assert.h>
+#include<memory>
+#include<new>
+#include"EspString.hpp"
+#include"EspArray.hpp"
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include<emmintrin.h>
+#define __ESPHASHMAP_SSE2__
+#endif
+#ifndef __ESPHASHMAP__
+#define __ESPHASHMAP__
+#endif
+
+//Hashes scalar keys by their bytes; specialize for types with padding or owned memory
+template<class EspType>
+struct EspHasher
+{
+	static unsigned long long GetHash(const EspType& Key) { return EspString::Hash((const char*)&Key, sizeof(EspType)); }
+	static bool IsEqual(const EspType& Key1, const EspType& Key2) { return Key1 == Key2; }
+};
+template<>
+struct EspHasher<EspString>
+{
+	static unsigned long long GetHash(const EspString& Key) { return Key.GetHash(); }
+	static bool IsEqual(const EspString& Key1, const EspString& Key2)
+	{
+		if (Key1.GetLength() != Key2.GetLength())
+			return false;
+		if (Key1.GetLength() == 0)
+			return true;
+		return Key1.GetHash() == Key2.GetHash() && ::memcmp(Key1.GetAnsiStr(), Key2.GetAnsiStr(), Key1.GetLength()) == 0;
+	}
+};
+
+//Open addressing with 16-wide control-byte groups (Swiss table); the low 7 hash bits are kept in the control byte
+template<class KeyType, class ValueType, class Hasher = EspHasher<KeyType>>
+class EspHashMap
+{
+private:
+	struct EspHashSlot
+	{
+		KeyType Key;
+		ValueType Value;
+		EspHashSlot(const KeyType& Key, const ValueType& Value) :Key(Key), Value(Value) {}
+	};
+	static const unsigned int GroupWidth = 16;
+	static const signed char Ctrl_Empty = -128;
+	static const signed char Ctrl_Deleted = -2;
+	static const bool Relocatable = EspIsRelocatable<KeyType>::value && EspIsRelocatable<ValueType>::value;
+
+	signed char* Control = nullptr;
+	EspHashSlot* Slots = nullptr;
+	unsigned int Capacity = 0;
+	unsigned int Count = 0;
+	unsigned int Tombstones = 0;
+
+	static unsigned int CountTrailingZeros(unsigned int Mask)
+	{
+#if defined(_MSC_VER)
+		unsigned long Index;
+		_BitScanForward(&Index, Mask);
+		return Index;
+#else
+		return __builtin_ctz(Mask);
+#endif
+	}
+	static unsigned int MatchTag(const signed char* Group, signed char Tag)
+	{
+#ifdef __ESPHASHMAP_SSE2__
+		__m128i Ctrl = _mm_loadu_si128((const __m128i*)Group);
+		return (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(Ctrl, _mm_set1_epi8(Tag)));
+#else
+		unsigned int Mask = 0;
+		for (unsigned int TimeNum = 0; TimeNum < GroupWidth; TimeNum++)
+			if (Group[TimeNum] == Tag)
+				Mask |= 1u << TimeNum;
+		return Mask;
+#endif
+	}
+	static unsigned int MatchEmptyOrDeleted(const signed char* Group)
+	{
+#ifdef __ESPHASHMAP_SSE2__
+		return (unsigned int)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)Group));
+#else
+		unsigned int Mask = 0;
+		for (unsigned int TimeNum = 0; TimeNum < GroupWidth; TimeNum++)
+			if (Group[TimeNum] < 0)
+				Mask |= 1u << TimeNum;
+		return Mask;
+#endif
+	}
+
+	unsigned int FindIndex(const KeyType& Key, unsigned long long HashValue)const
+	{
+		if (Capacity == 0)
+			return -1;
+		unsigned int GroupMask = Capacity / GroupWidth - 1;
+		unsigned int GroupIndex = (unsigned int)(HashValue >> 7) & GroupMask;
+		signed char Tag = (signed char)(HashValue & 0x7F);
+		for (unsigned int Step = 1; Step <= GroupMask + 1; Step++)
+		{
+			const signed char* Group = Control + GroupIndex * GroupWidth;
+			unsigned int Matches = EspHashMap::MatchTag(Group, Tag);
+			while (Matches != 0)
+			{
+				unsigned int Index = GroupIndex * GroupWidth + EspHashMap::CountTrailingZeros(Matches);
+				if (Hasher::IsEqual(Slots[Index].Key, Key))
+					return Index;
+				Matches &= Matches - 1;
+			}
+			if (EspHashMap::MatchTag(Group, Ctrl_Empty) != 0)
+				return -1;
+			GroupIndex = (GroupIndex + Step) & GroupMask;
+		}
+		return -1;
+	}
+	unsigned int FindFreeIndex(unsigned long long HashValue)const
+	{
+		unsigned int GroupMask = Capacity / GroupWidth - 1;
+		unsigned int GroupIndex = (unsigned int)(HashValue >> 7) & GroupMask;
+		for (unsigned int Step = 1; ; Step++)
+		{
+			unsigned int Free = EspHashMap::MatchEmptyOrDeleted(Control + GroupIndex * GroupWidth);
+			if (Free != 0)
+				return GroupIndex * GroupWidth + EspHashMap::CountTrailingZeros(Free);
+			GroupIndex = (GroupIndex + Step) & GroupMask;
+		}
+	}
+	void Rehash(unsigned int NewCapacity)
+	{
+		//Both tables are allocated before the map changes, so a failed allocation leaves it as it was
+		signed char* NewControl = (signed char*)::malloc(NewCapacity * sizeof(signed char));
+		EspHashSlot* NewSlots = (EspHashSlot*)::malloc(NewCapacity * sizeof(EspHashSlot));
+		if (NewControl == NULL || NewSlots == NULL)
+		{
+			::free(NewControl);
+			::free(NewSlots);
+			throw("Allocate Buffer Unsuccessfully!");
+		}
+		::memset(NewControl, Ctrl_Empty, NewCapacity * sizeof(signed char));
+		signed char* OldControl = Control;
+		EspHashSlot* OldSlots = Slots;
+		unsigned int OldCapacity = Capacity;
+		Control = NewControl;
+		Slots = NewSlots;
+		Capacity = NewCapacity;
+		Tombstones = 0;
+		for (unsigned int TimeNum = 0; TimeNum < OldCapacity; TimeNum++)
+			if (OldControl[TimeNum] >= 0)
+			{
+				//EspString keys answer from their cached hash, which moves with them
+				unsigned long long HashValue = Hasher::GetHash(OldSlots[TimeNum].Key);
+				unsigned int Index = FindFreeIndex(HashValue);
+				Control[Index] = (signed char)(HashValue & 0x7F);
+				if (Relocatable)
+					::memcpy((void*)(Slots + Index), (const void*)(OldSlots + TimeNum), sizeof(EspHashSlot));
+				else
+				{
+					::new(Slots + Index)EspHashSlot(std::move(OldSlots[TimeNum]));
+					(OldSlots + TimeNum)->~EspHashSlot();
+				}
+			}
+		if (OldControl != NULL)
+			::free(OldControl);
+		if (OldSlots != NULL)
+			::free(OldSlots);
+	}
+	bool NeedsRehash()const { return (Count + Tombstones + 1) * 8 > Capacity * 7; }
+	unsigned int PrepareInsert(unsigned long long HashValue)
+	{
+		if (NeedsRehash())
+			Rehash(Count * 2 >= Capacity ? (Capacity == 0 ? GroupWidth : Capacity * 2) : Capacity);
+		unsigned int Index = FindFreeIndex(HashValue);
+		if (Control[Index] == Ctrl_Deleted)
+			Tombstones--;
+		Control[Index] = (signed char)(HashValue & 0x7F);
+		Count++;
+		return Index;
+	}
+	//Key and Value may refer into this map, e.g. SetValue(Key2, GetValue(Key1)), so they are copied before a rehash frees them
+	unsigned int InsertSlot(const KeyType& Key, const ValueType& Value, unsigned long long HashValue)
+	{
+		if (NeedsRehash())
+		{
+			EspHashSlot Slot(Key, Value);
+			unsigned int Index = PrepareInsert(HashValue);
+			::new(Slots + Index)EspHashSlot(std::move(Slot));
+			return Index;
+		}
+		unsigned int Index = PrepareInsert(HashValue);
+		::new(Slots + Index)EspHashSlot(Key, Value);
+		return Index;
+	}
+
+public:
+	EspHashMap() {}
+	EspHashMap(const EspHashMap& HashMap)
+	{
+		Reserve(HashMap.Count);
+		for (unsigned int TimeNum = 0; TimeNum < HashMap.Capacity; TimeNum++)
+			if (HashMap.Control[TimeNum] >= 0)
+				SetValue(HashMap.Slots[TimeNum].Key, HashMap.Slots[TimeNum].Value);
+	}
+	~EspHashMap()
+	{
+		Empty();
+		if (Control != NULL)
+			::free(Control);
+		if (Slots != NULL)
+			::free(Slots);
+		Control = NULL;
+		Slots = NULL;
+		Capacity = 0;
+	}
+	const EspHashMap& operator=(const EspHashMap& HashMap)
+	{
+		if (&HashMap != this)
+		{
+			Empty();
+			Reserve(HashMap.Count);
+			for (unsigned int TimeNum = 0; TimeNum < HashMap.Capacity; TimeNum++)
+				if (HashMap.Control[TimeNum] >= 0)
+					SetValue(HashMap.Slots[TimeNum].Key, HashMap.Slots[TimeNum].Value);
+		}
+		return *this;
+	}
+
+	void Reserve(unsigned int nCount)
+	{
+		unsigned int NewCapacity = GroupWidth;
+		while (NewCapacity * 7 < nCount * 8)
+			NewCapacity *= 2;
+		if (NewCapacity > Capacity)
+			Rehash(NewCapacity);
+	}
+	void SetValue(const KeyType& Key, const ValueType& Value)
+	{
+		unsigned long long HashValue = Hasher::GetHash(Key);
+		unsigned int Index = FindIndex(Key, HashValue);
+		if (Index != (unsigned int)-1)
+			Slots[Index].Value = Value;
+		else
+			InsertSlot(Key, Value, HashValue);
+	}
+	bool AddElement(const KeyType& Key, const ValueType& Value)
+	{
+		unsigned long long HashValue = Hasher::GetHash(Key);
+		if (FindIndex(Key, HashValue) != (unsigned int)-1)
+			return false;
+		InsertSlot(Key, Value, HashValue);
+		return true;
+	}
+	ValueType* Find(const KeyType& Key)const
+	{
+		unsigned int Index = FindIndex(Key, Hasher::GetHash(Key));
+		return Index != (unsigned int)-1 ? &Slots[Index].Value : NULL;
+	}
+	bool Contains(const KeyType& Key)const { return Find(Key) != NULL; }
+	ValueType& GetValue(const KeyType& Key)
+	{
+		unsigned long long HashValue = Hasher::GetHash(Key);
+		unsigned int Index = FindIndex(Key, HashValue);
+		if (Index == (unsigned int)-1)
+			Index = InsertSlot(Key, ValueType(), HashValue);
+		return Slots[Index].Value;
+	}
+	ValueType& operator[](const KeyType& Key) { return GetValue(Key); }
+	bool DeleteElement(const KeyType& Key)
+	{
+		unsigned int Index = FindIndex(Key, Hasher::GetHash(Key));
+		if (Index == (unsigned int)-1)
+			return false;
+		(Slots + Index)->~EspHashSlot();
+		if (EspHashMap::MatchTag(Control + (Index & ~(GroupWidth - 1)), Ctrl_Empty) != 0)
+			Control[Index] = Ctrl_Empty;
+		else
+		{
+			Control[Index] = Ctrl_Deleted;
+			Tombstones++;
+		}
+		Count--;
+		return true;
+	}
+
+	template<class FuncType>
+	void ForEach(FuncType Func)
+	{
+		for (unsigned int TimeNum = 0; TimeNum < Capacity; TimeNum++)
+			if (Control[TimeNum] >= 0)
+				Func(Slots[TimeNum].Key, Slots[TimeNum].Value);
+	}
+	unsigned int GetCount()const { return Count; }
+	unsigned int GetBufSize()const { return Capacity; }
+	bool IsEmpty()const { return Count == 0; }
+
+	void Empty()
+	{
+		for (unsigned int TimeNum = 0; TimeNum < Capacity; TimeNum++)
+			if (Control[TimeNum] >= 0)
+				(Slots + TimeNum)->~EspHashSlot();
+		if (Control != NULL)
+			::memset(Control, Ctrl_Empty, Capacity * sizeof(signed char));
+		Count = Tombstones = 0;
+	}
+};
@@ -0,0 +1,440 @@
+#pragma once
+#include<string.h>
+#include<limits>
+#include<tuple>
+#include<type_traits>
+#include<utility>
+#include"EspJsonParser.hpp"
+#ifndef __ESPJSONBINDING__
+#define __ESPJSONBINDING__
+#endif
+
+//Binds a struct's fields to JSON keys at compile time, so EspJsonParser::ParseStruct writes numbers, booleans and
+//strings straight into the fields without building EspJsonValue trees:
+//	struct Order { int Id; double Price; EspString Symbol; EspArray<int> Lots; };
+//	ESP_JSON_BIND(Order, Id, Price, Symbol, Lots)
+//The key is the field name. ESP_JSON_BIND specializes EspJsonBinding, so it must be used at global scope;
+//a struct with private fields has to befriend EspJsonBinding<Type>.
+template<class StructType, class FieldType>
+struct EspJsonField
+{
+	const char* Name;
+	unsigned int Length;
+	FieldType StructType::* Member;
+};
+template<class StructType, class FieldType, unsigned int NameSize>
+constexpr EspJsonField<StructType, FieldType> EspJsonMakeField(const char(&lpszName)[NameSize], FieldType StructType::* Member)
+{
+	return EspJsonField<StructType, FieldType>{ lpszName, NameSize - 1, Member };
+}
+template<class StructType>
+struct EspJsonBinding
+{
+	static const bool IsBound = false;
+};
+
+//MSVC passes __VA_ARGS__ on as a single argument unless it is rescanned, hence ESP_JSON_EXPAND
+#define ESP_JSON_EXPAND(x) x
+#define ESP_JSON_FIELD(Type, Name) EspJsonMakeField(#Name, &Type::Name)
+#define ESP_JSON_FIELDS_1(Type, Name) ESP_JSON_FIELD(Type, Name)
+#define ESP_JSON_FIELDS_2(Type, Name, ...) ESP_JSON_FIELD(Type, Name), ESP_JSON_EXPAND(ESP_JSON_FIELDS_1(Type, __VA_ARGS__))
+#define ESP_JSON_FIELDS_3(Type, Name, ...) ESP_JSON_FIELD(Type, Name), ESP_JSON_EXPAND(ESP_JSON_FIELDS_2(Type, __VA_ARGS__))
+#define ESP_JSON_FIELDS_4(Type, Name, ...) ESP_JSON_FIELD(Type, Name), ESP_JSON_EXPAND(ESP_JSON_FIELDS_3(Type, __VA_ARGS__))
+#define ESP_JSON_FIELDS_5(Type, Name, ...) ESP_JSON_FIELD(Type, Name), ESP_JSON_EXPAND(ESP_JSON_FIELDS_4(Type, __VA_ARGS__))
+#define ESP_JSON_FIELDS_6(Type, Name, ...) ESP_JSON_FIELD(Type, Name), ESP_JSON_EXPAND(ESP_JSON_FIELDS_5(Type, __VA_ARGS__))
+#define ESP_JSON_FIELDS_7(Type, Name, ...) ESP_JSON_FIELD(Type, Name), ESP_JSON_EXPAND(ESP_JSON_FIELDS_6(Type, __VA_ARGS__))
+#define ESP_JSON_FIELDS_8(Type, Name, ...) ESP_JSON_FIELD(Type, Name), ESP_JSON_EXPAND(ESP_JSON_FIELDS_7(Type, __VA_ARGS__))
+#define ESP_JSON_FIELDS_9(Type, Name, ...) ESP_JSON_FIELD(Type, Name), ESP_JSON_EXPAND(ESP_JSON_FIELDS_8(Type, __VA_ARGS__))
+#define ESP_JSON_FIELDS_10(Type, Name, ...) ESP_JSON_FIELD(Type, Name), ESP_JSON_EXPAND(ESP_JSON_FIELDS_9(Type, __VA_ARGS__))
+#define ESP_JSON_FIELDS_11(Type, Name, ...) ESP_JSON_FIELD(Type, Name), ESP_JSON_EXPAND(ESP_JSON_FIELDS_10(Type, __VA_ARGS__))
+#define ESP_JSON_FIELDS_12(Type, Name, ...) ESP_JSON_FIELD(Type, Name), ESP_JSON_EXPAND(ESP_JSON_FIELDS_11(Type, __VA_ARGS__))
+#define ESP_JSON_FIELDS_13(Type, Name, ...) ESP_JSON_FIELD(Type, Name), ESP_JSON_EXPAND(ESP_JSON_FIELDS_12(Type, __VA_ARGS__))
+#define ESP_JSON_FIELDS_14(Type, Name, ...) ESP_JSON_FIELD(Type, Name), ESP_JSON_EXPAND(ESP_JSON_FIELDS_13(Type, __VA_ARGS__))
+#define ESP_JSON_FIELDS_15(Type, Name, ...) ESP_JSON_FIELD(Type, Name), ESP_JSON_EXPAND(ESP_JSON_FIELDS_14(Type, __VA_ARGS__))
+#define ESP_JSON_FIELDS_16(Type, Name, ...) ESP_JSON_FIELD(Type, Name), ESP_JSON_EXPAND(ESP_JSON_FIELDS_15(Type, __VA_ARGS__))
+#define ESP_JSON_FIELDS_17(Type, Name, ...) ESP_JSON_FIELD(Type, Name), ESP_JSON_EXPAND(ESP_JSON_FIELDS_16(Type, __VA_ARGS__))
+#define ESP_JSON_FIELDS_18(Type, Name, ...) ESP_JSON_FIELD(Type, Name), ESP_JSON_EXPAND(ESP_JSON_FIELDS_17(Type, __VA_ARGS__))
+#define ESP_JSON_FIELDS_19(Type, Name, ...) ESP_JSON_FIELD(Type, Name), ESP_JSON_EXPAND(ESP_JSON_FIELDS_18(Type, __VA_ARGS__))
+#define ESP_JSON_FIELDS_20(Type, Name, ...) ESP_JSON_FIELD(Type, Name), ESP_JSON_EXPAND(ESP_JSON_FIELDS_19(Type, __VA_ARGS__))
+#define ESP_JSON_FIELDS_21(Type, Name, ...) ESP_JSON_FIELD(Type, Name), ESP_JSON_EXPAND(ESP_JSON_FIELDS_20(Type, __VA_ARGS__))
+#define ESP_JSON_FIELDS_22(Type, Name, ...) ESP_JSON_FIELD(Type, Name), ESP_JSON_EXPAND(ESP_JSON_FIELDS_21(Type, __VA_ARGS__))
+#define ESP_JSON_FIELDS_23(Type, Name, ...) ESP_JSON_FIELD(Type, Name), ESP_JSON_EXPAND(ESP_JSON_FIELDS_22(Type, __VA_ARGS__))
+#define ESP_JSON_FIELDS_24(Type, Name, ...) ESP_JSON_FIELD(Type, Name), ESP_JSON_EXPAND(ESP_JSON_FIELDS_23(Type, __VA_ARGS__))
+#define ESP_JSON_FIELDS_25(Type, Name, ...) ESP_JSON_FIELD(Type, Name), ESP_JSON_EXPAND(ESP_JSON_FIELDS_24(Type, __VA_ARGS__))
+#define ESP_JSON_FIELDS_26(Type, Name, ...) ESP_JSON_FIELD(Type, Name), ESP_JSON_EXPAND(ESP_JSON_FIELDS_25(Type, __VA_ARGS__))
+#define ESP_JSON_FIELDS_27(Type, Name, ...) ESP_JSON_FIELD(Type, Name), ESP_JSON_EXPAND(ESP_JSON_FIELDS_26(Type, __VA_ARGS__))
+#define ESP_JSON_FIELDS_28(Type, Name, ...) ESP_JSON_FIELD(Type, Name), ESP_JSON_EXPAND(ESP_JSON_FIELDS_27(Type, __VA_ARGS__))
+#define ESP_JSON_FIELDS_29(Type, Name, ...) ESP_JSON_FIELD(Type, Name), ESP_JSON_EXPAND(ESP_JSON_FIELDS_28(Type, __VA_ARGS__))
+#define ESP_JSON_FIELDS_30(Type, Name, ...) ESP_JSON_FIELD(Type, Name), ESP_JSON_EXPAND(ESP_JSON_FIELDS_29(Type, __VA_ARGS__))
+#define ESP_JSON_FIELDS_31(Type, Name, ...) ESP_JSON_FIELD(Type, Name), ESP_JSON_EXPAND(ESP_JSON_FIELDS_30(Type, __VA_ARGS__))
+#define ESP_JSON_FIELDS_32(Type, Name, ...) ESP_JSON_FIELD(Type, Name), ESP_JSON_EXPAND(ESP_JSON_FIELDS_31(Type, __VA_ARGS__))
+#define ESP_JSON_SELECT(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15, _16, _17, _18, _19, _20, _21, _22, _23, _24, _25, _26, _27, _28, _29, _30, _31, _32, Macro, ...) Macro
+#define ESP_JSON_FIELDS(Type, ...) ESP_JSON_EXPAND(ESP_JSON_EXPAND(ESP_JSON_SELECT(__VA_ARGS__, ESP_JSON_FIELDS_32, ESP_JSON_FIELDS_31, ESP_JSON_FIELDS_30, ESP_JSON_FIELDS_29, ESP_JSON_FIELDS_28, ESP_JSON_FIELDS_27, ESP_JSON_FIELDS_26, ESP_JSON_FIELDS_25, ESP_JSON_FIELDS_24, ESP_JSON_FIELDS_23, ESP_JSON_FIELDS_22, ESP_JSON_FIELDS_21, ESP_JSON_FIELDS_20, ESP_JSON_FIELDS_19, ESP_JSON_FIELDS_18, ESP_JSON_FIELDS_17, ESP_JSON_FIELDS_16, ESP_JSON_FIELDS_15, ESP_JSON_FIELDS_14, ESP_JSON_FIELDS_13, ESP_JSON_FIELDS_12, ESP_JSON_FIELDS_11, ESP_JSON_FIELDS_10, ESP_JSON_FIELDS_9, ESP_JSON_FIELDS_8, ESP_JSON_FIELDS_7, ESP_JSON_FIELDS_6, ESP_JSON_FIELDS_5, ESP_JSON_FIELDS_4, ESP_JSON_FIELDS_3, ESP_JSON_FIELDS_2, ESP_JSON_FIELDS_1))(Type, __VA_ARGS__))
+#define ESP_JSON_BIND(Type, ...)\
+	template<> struct EspJsonBinding<Type>\
+	{\
+		static const bool IsBound = true;\
+		static constexpr auto GetFields() { return std::make_tuple(ESP_JSON_FIELDS(Type, __VA_ARGS__)); }\
+	};
+
+constexpr unsigned int EspJsonHashKey(const char* lpszKey, unsigned int nLength, unsigned int nSeed)
+{
+	unsigned int Hash = nSeed ^ nLength;
+	for (unsigned int TimeNum = 0; TimeNum < nLength; TimeNum++)
+		Hash = (Hash ^ (unsigned char)lpszKey[TimeNum]) * 16777619u;
+	return Hash ^ (Hash >> 16);
+}
+constexpr unsigned int EspJsonGetSlotCount(unsigned int FieldCount)
+{
+	unsigned int SlotCount = 8;
+	while (SlotCount < FieldCount * 8)
+		SlotCount *= 2;
+	return SlotCount;
+}
+
+//Perfect hash of a binding's keys: the compiler tries seeds until every key lands in its own slot,
+//so a lookup is one hash, one slot read and one compare against the only candidate
+template<class StructType>
+class EspJsonFieldTable
+{
+public:
+	typedef decltype(EspJsonBinding<StructType>::GetFields()) FieldsType;
+	static const unsigned int FieldCount = std::tuple_size<FieldsType>::value;
+	static const unsigned int SlotCount = EspJsonGetSlotCount(FieldCount);
+	static const unsigned int MaxSeed = 1 << 16;
+	static const unsigned char NoField = 0xFF;
+	static_assert(FieldCount < NoField, "Too many fields in one ESP_JSON_BIND");
+
+	//0 when no seed separates the keys, which only happens when two names are equal
+	unsigned int Seed = 0;
+	const char* Names[FieldCount] = {};
+	unsigned int Lengths[FieldCount] = {};
+	unsigned char Slots[SlotCount] = {};
+
+private:
+	template<size_t... Indexes>
+	constexpr void LoadNames(std::index_sequence<Indexes...>)
+	{
+		constexpr FieldsType Fields = EspJsonBinding<StructType>::GetFields();
+		const char* NameList[] = { std::get<Indexes>(Fields).Name... };
+		unsigned int LengthList[] = { std::get<Indexes>(Fields).Length... };
+		for (unsigned int TimeNum = 0; TimeNum < FieldCount; TimeNum++)
+		{
+			Names[TimeNum] = NameList[TimeNum];
+			Lengths[TimeNum] = LengthList[TimeNum];
+		}
+	}
+	constexpr bool HasDuplicates()const
+	{
+		for (unsigned int First = 0; First < FieldCount; First++)
+			for (unsigned int Second = First + 1; Second < FieldCount; Second++)
+			{
+				bool Equal = Lengths[First] == Lengths[Second];
+				for (unsigned int TimeNum = 0; Equal && TimeNum < Lengths[First]; TimeNum++)
+					Equal = Names[First][TimeNum] == Names[Second][TimeNum];
+				if (Equal)
+					return true;
+			}
+		return false;
+	}
+	constexpr bool TrySeed(unsigned int nSeed)
+	{
+		for (unsigned int TimeNum = 0; TimeNum < SlotCount; TimeNum++)
+			Slots[TimeNum] = NoField;
+		for (unsigned int TimeNum = 0; TimeNum < FieldCount; TimeNum++)
+		{
+			unsigned int Slot = EspJsonHashKey(Names[TimeNum], Lengths[TimeNum], nSeed) & (SlotCount - 1);
+			if (Slots[Slot] != NoField)
+				return false;
+			Slots[Slot] = (unsigned char)TimeNum;
+		}
+		return true;
+	}
+
+public:
+	constexpr EspJsonFieldTable()
+	{
+		LoadNames(std::make_index_sequence<FieldCount>());
+		if (HasDuplicates())
+			return;
+		for (unsigned int nSeed = 1; nSeed <= MaxSeed; nSeed++)
+			if (TrySeed(nSeed))
+			{
+				Seed = nSeed;
+				return;
+			}
+	}
+	//Index of the field named lpszKey, or -1
+	unsigned int Find(const char* lpszKey, unsigned int nLength)const
+	{
+		unsigned int Index = Slots[EspJsonHashKey(lpszKey, nLength, Seed) & (SlotCount - 1)];
+		if (Index == NoField || Lengths[Index] != nLength || ::memcmp(Names[Index], lpszKey, nLength) != 0)
+			return -1;
+		return Index;
+	}
+};
+template<class StructType>
+struct EspJsonFieldIndex
+{
+	static constexpr EspJsonFieldTable<StructType> Table = EspJsonFieldTable<StructType>();
+	static_assert(Table.Seed != 0, "ESP_JSON_BIND field names must be distinct");
+};
+template<class StructType>
+constexpr EspJsonFieldTable<StructType> EspJsonFieldIndex<StructType>::Table;
+
+//Receives values nobody asked for
+struct EspJsonSkipBuilder
+{
+	void Reset() {}
+	void AddNull() {}
+	void AddBoolean(bool) {}
+	void AddNumber(double) {}
+	void AddString(const EspString&) {}
+	void AddKey(const EspString&) {}
+	void OpenContainer(char) {}
+	void CloseContainer(char) {}
+};
+
+//Reads one JSON value into a C++ field; the overload is picked by the field's type
+struct EspJsonBindingReader
+{
+	static bool EnterContainer(EspJsonParser& Parser)
+	{
+		if (Parser.StructDepth >= Parser.MaxDepth)
+		{
+			Parser.ErrorCode = EspJsonErrorCode::Error_Depth_Exceeded;
+			return false;
+		}
+		Parser.StructDepth++;
+		return true;
+	}
+	//Points Key into the input when the key has no escapes, otherwise into the parser's scratch string
+	static bool ReadKey(EspJsonParser& Parser, const char*& Key, unsigned int& Length)
+	{
+		const char* Start = Parser.Input + Parser.ParsePos + 1;
+		const char* End = Parser.Input + Parser.InputLength;
+		const char* Stop = EspJsonParser::FindStringSpecial(Start, End);
+		if (Stop < End && *Stop == '"')
+		{
+			Key = Start;
+			Length = (unsigned int)(Stop - Start);
+			Parser.ParsePos = (unsigned int)(Stop + 1 - Parser.Input);
+			return true;
+		}
+		Parser.ParseKey(Parser.ValueScratch);
+		Key = Parser.ValueScratch.GetAnsiStr();
+		Length = Parser.ValueScratch.GetLength();
+		return Parser.ErrorCode == EspJsonErrorCode::Error_NoError;
+	}
+
+	static void ReadValue(EspJsonParser& Parser, bool& Value)
+	{
+		if (Parser.GetChar() == 't')
+		{
+			if (Parser.ParseLiteral("true"))
+				Value = true;
+		}
+		else if (Parser.GetChar() == 'f')
+		{
+			if (Parser.ParseLiteral("false"))
+				Value = false;
+		}
+		else
+			Parser.ErrorCode = EspJsonErrorCode::Error_Invalid_Character;
+	}
+	//Plain integers are accumulated digit by digit; fractions and exponents go through ParseNumber and are truncated.
+	//Values the field cannot hold fail with Error_Invalid_Number instead of wrapping.
+	template<class IntegerType>
+	static typename std::enable_if<std::is_integral<IntegerType>::value>::type ReadValue(EspJsonParser& Parser, IntegerType& Value)
+	{
+		typedef std::numeric_limits<IntegerType> Limits;
+		unsigned int Start = Parser.ParsePos;
+		bool Negative = Parser.GetChar() == '-';
+		if (Negative)
+			Parser.ParsePos++;
+		unsigned long long Magnitude = 0;
+		unsigned int DigitCount = 0;
+		bool Overflow = false;
+		while (Parser.GetChar() >= '0' && Parser.GetChar() <= '9')
+		{
+			unsigned int Digit = Parser.GetChar() - '0';
+			if (Magnitude > (std::numeric_limits<unsigned long long>::max() - Digit) / 10)
+				Overflow = true;
+			else
+				Magnitude = Magnitude * 10 + Digit;
+			Parser.ParsePos++;
+			//A leading zero is the whole integer part
+			if (++DigitCount == 1 && Magnitude == 0)
+				break;
+		}
+		char Next = Parser.GetChar();
+		if (DigitCount == 0 || Next == '.' || Next == 'e' || Next == 'E')
+		{
+			Parser.ParsePos = Start;
+			double Number;
+			if (!Parser.ParseNumber(Number))
+				return;
+			if (Number > (double)Limits::min() - 1.0 && Number < (double)Limits::max() + 1.0)
+				Value = (IntegerType)Number;
+			else
+			{
+				Parser.ParsePos = Start;
+				Parser.ErrorCode = EspJsonErrorCode::Error_Invalid_Number;
+			}
+			return;
+		}
+		unsigned long long Limit = Negative ? (Limits::is_signed ? (unsigned long long)Limits::max() + 1 : 0) : (unsigned long long)Limits::max();
+		if (Overflow || Magnitude > Limit)
+		{
+			Parser.ParsePos = Start;
+			Parser.ErrorCode = EspJsonErrorCode::Error_Invalid_Number;
+			return;
+		}
+		Value = (IntegerType)(Negative ? 0 - Magnitude : Magnitude);
+	}
+	template<class FloatType>
+	static typename std::enable_if<std::is_floating_point<FloatType>::value>::type ReadValue(EspJsonParser& Parser, FloatType& Value)
+	{
+		double Number;
+		if (Parser.ParseNumber(Number))
+			Value = (FloatType)Number;
+	}
+	static void ReadValue(EspJsonParser& Parser, EspString& Value) { Parser.ParseKey(Value); }
+	//Any JSON value, kept as a tree
+	static void ReadValue(EspJsonParser& Parser, EspJsonValue& Value)
+	{
+		Parser.ParseDocument(Parser.TreeBuilder);
+		if (Parser.ErrorCode == EspJsonErrorCode::Error_NoError)
+			Value = Parser.TreeBuilder.Root;
+		Parser.TreeBuilder.Reset();
+	}
+	template<class EspType, unsigned int InlineCount>
+	static void ReadValue(EspJsonParser& Parser, EspArray<EspType, InlineCount>& Value)
+	{
+		if (Parser.GetChar() != '[')
+		{
+			Parser.ErrorCode = EspJsonErrorCode::Error_Miss_Bracket;
+			return;
+		}
+		if (!EspJsonBindingReader::EnterContainer(Parser))
+			return;
+		Parser.ParsePos++;
+		Value.Empty();
+		Parser.SkipWhitespace();
+		if (Parser.GetChar() == ']')
+			Parser.ParsePos++;
+		else
+			while (true)
+			{
+				EspJsonBindingReader::ReadMember(Parser, Value.Emplace());
+				if (Parser.ErrorCode != EspJsonErrorCode::Error_NoError)
+					break;
+				Parser.SkipWhitespace();
+				if (Parser.GetChar() == ',')
+				{
+					Parser.ParsePos++;
+					continue;
+				}
+				if (Parser.GetChar() == ']')
+					Parser.ParsePos++;
+				else
+					Parser.ErrorCode = EspJsonErrorCode::Error_Miss_Comma;
+				break;
+			}
+		Parser.StructDepth--;
+	}
+	//Keys are dispatched through the struct's perfect hash; unknown keys are parsed and dropped
+	template<class StructType>
+	static typename std::enable_if<EspJsonBinding<StructType>::IsBound>::type ReadValue(EspJsonParser& Parser, StructType& Value)
+	{
+		typedef EspJsonFieldTable<StructType> TableType;
+		if (Parser.GetChar() != '{')
+		{
+			Parser.ErrorCode = EspJsonErrorCode::Error_Miss_Brace;
+			return;
+		}
+		if (!EspJsonBindingReader::EnterContainer(Parser))
+			return;
+		Parser.ParsePos++;
+		Parser.SkipWhitespace();
+		if (Parser.GetChar() == '}')
+			Parser.ParsePos++;
+		else
+			while (true)
+			{
+				const char* Key;
+				unsigned int Length;
+				if (Parser.GetChar() != '"')
+				{
+					Parser.ErrorCode = EspJsonErrorCode::Error_Miss_Quote;
+					break;
+				}
+				if (!EspJsonBindingReader::ReadKey(Parser, Key, Length))
+					break;
+				Parser.SkipWhitespace();
+				if (Parser.GetChar() != ':')
+				{
+					Parser.ErrorCode = EspJsonErrorCode::Error_Miss_Colon;
+					break;
+				}
+				Parser.ParsePos++;
+				unsigned int Index = EspJsonFieldIndex<StructType>::Table.Find(Key, Length);
+				if (Index == (unsigned int)-1)
+				{
+					EspJsonSkipBuilder Builder;
+					Parser.ParseDocument(Builder);
+				}
+				else
+					EspJsonBindingReader::ReadField(Parser, Value, Index, std::make_index_sequence<TableType::FieldCount>());
+				if (Parser.ErrorCode != EspJsonErrorCode::Error_NoError)
+					break;
+				Parser.SkipWhitespace();
+				if (Parser.GetChar() == ',')
+				{
+					Parser.ParsePos++;
+					Parser.SkipWhitespace();
+					continue;
+				}
+				if (Parser.GetChar() == '}')
+					Parser.ParsePos++;
+				else
+					Parser.ErrorCode = EspJsonErrorCode::Error_Miss_Comma;
+				break;
+			}
+		Parser.StructDepth--;
+	}
+	//null leaves the field as it was, except an EspJsonValue field, which becomes Value_Null
+	template<class FieldType>
+	static void ReadMember(EspJsonParser& Parser, FieldType& Value)
+	{
+		Parser.SkipWhitespace();
+		if (Parser.GetChar() == 'n' && !std::is_same<FieldType, EspJsonValue>::value)
+			Parser.ParseLiteral("null");
+		else
+			EspJsonBindingReader::ReadValue(Parser, Value);
+	}
+	template<class StructType, size_t Index>
+	static void ReadIndexedField(EspJsonParser& Parser, StructType& Value)
+	{
+		constexpr auto Field = std::get<Index>(EspJsonBinding<StructType>::GetFields());
+		EspJsonBindingReader::ReadMember(Parser, Value.*Field.Member);
+	}
+	template<class StructType, size_t... Indexes>
+	static void ReadField(EspJsonParser& Parser, StructType& Value, unsigned int Index, std::index_sequence<Indexes...>)
+	{
+		typedef void(*ReaderType)(EspJsonParser&, StructType&);
+		static const ReaderType Readers[] = { &EspJsonBindingReader::ReadIndexedField<StructType, Indexes>... };
+		Readers[Index](Parser, Value);
+	}
+};
+
+template<class StructType>
+bool EspJsonParser::ParseStruct(StructType& Value)
+{
+	static_assert(EspJsonBinding<StructType>::IsBound, "ParseStruct needs a struct registered with ESP_JSON_BIND");
+	this->RewindInput();
+	this->StructDepth = 0;
+	this->SkipWhitespace();
+	EspJsonBindingReader::ReadValue(*this, Value);
+	return this->ErrorCode == EspJsonErrorCode::Error_NoError;
+}
@@ -0,0 +1,199 @@
+#pragma once
+#include<assert.h>
+#if defined(_WIN32)
+#include<io.h>
+#else
+#include<limits.h>
+#include<sys/uio.h>
+#include<unistd.h>
+#endif
+#include"EspJsonParser.hpp"
+#include"EspParallel.hpp"
+#ifndef __ESPJSONPARALLEL__
+#define __ESPJSONPARALLEL__
+#endif
+
+//Serializes one large object or array on a thread pool. The members are cut into Grain-sized pieces, every piece
+//is written into its own buffer by EspJsonWriter, and the buffers are spliced in order, so the text is byte for byte
+//what Synthesize() produces. Nested containers are written whole by the piece that holds them.
+//The piece buffers are kept between calls, so a reused writer stops allocating once they have grown.
+class EspJsonParallelWriter
+{
+private:
+	static const unsigned int MinGrain = 64;
+
+	EspArray<EspString> Pieces;
+	unsigned int PieceCount = 0;
+	char Open = '\0';
+	char Close = '\0';
+
+	unsigned int Prepare(char nOpen, char nClose, unsigned int Count, unsigned int& Grain, EspThreadPool& Pool)
+	{
+		if (Grain == 0)
+		{
+			EspGetChunkCount(Count, Grain, Pool);
+			Grain = Grain > MinGrain ? Grain : MinGrain;
+		}
+		Open = nOpen;
+		Close = nClose;
+		PieceCount = Count > 0 ? (Count + Grain - 1) / Grain : 0;
+		if (Pieces.GetCount() < PieceCount)
+			Pieces.Resize(PieceCount);
+		for (unsigned int TimeNum = 0; TimeNum < PieceCount; TimeNum++)
+			Pieces.GetElementAt(TimeNum).Empty();
+		return PieceCount;
+	}
+#if defined(_WIN32)
+	static bool WriteAll(int FileDescriptor, const char* Data, unsigned int Length)
+	{
+		while (Length > 0)
+		{
+			int Written = ::_write(FileDescriptor, Data, Length);
+			if (Written <= 0)
+				return false;
+			Data += Written;
+			Length -= Written;
+		}
+		return true;
+	}
+#endif
+
+public:
+	//Grain = 0 picks about eight pieces per worker, but never fewer than 64 members per piece
+	void Write(const EspJsonArray& JsonArray, unsigned int Grain = 0, EspThreadPool& Pool = EspThreadPool::GetDefault())
+	{
+		Prepare('[', ']', JsonArray.GetCount(), Grain, Pool);
+		EspString* PieceData = Pieces.GetBuffer();
+		unsigned int PieceSize = Grain;
+		EspParallelFor(JsonArray.GetCount(), Grain, [&JsonArray, PieceData, PieceSize](unsigned int Begin, unsigned int End)
+			{
+				EspJsonWriter::WriteElements(JsonArray, Begin, End, PieceData[Begin / PieceSize]);
+			}, Pool);
+	}
+	void Write(const EspJsonObject& JsonObject, unsigned int Grain = 0, EspThreadPool& Pool = EspThreadPool::GetDefault())
+	{
+		Prepare('{', '}', JsonObject.GetCount(), Grain, Pool);
+		EspString* PieceData = Pieces.GetBuffer();
+		unsigned int PieceSize = Grain;
+		EspParallelFor(JsonObject.GetCount(), Grain, [&JsonObject, PieceData, PieceSize](unsigned int Begin, unsigned int End)
+			{
+				EspJsonWriter::WriteMembers(JsonObject, Begin, End, PieceData[Begin / PieceSize]);
+			}, Pool);
+	}
+	void Write(const EspJsonValue& Value, unsigned int Grain = 0, EspThreadPool& Pool = EspThreadPool::GetDefault())
+	{
+		if (Value.IsObject())
+			Write(Value.GetJsonObject(), Grain, Pool);
+		else if (Value.IsArray())
+			Write(Value.GetJsonArray(), Grain, Pool);
+		else
+		{
+			Grain = 1;
+			Prepare('\0', '\0', 1, Grain, Pool);
+			EspJsonWriter::WriteValue(Value, Pieces.GetElementAt(0));
+		}
+	}
+
+	//Length of the text from the last Write
+	unsigned int GetLength()const
+	{
+		unsigned int Length = Open != '\0' ? 2 : 0;
+		for (unsigned int TimeNum = 0; TimeNum < PieceCount; TimeNum++)
+			Length += Pieces.GetElementAt(TimeNum).GetLength();
+		return Length;
+	}
+	//Splices the pieces into Output with one copy each
+	void GetString(EspString& Output)const
+	{
+		Output.Empty();
+		Output.Reserve(GetLength());
+		if (Open != '\0')
+			Output.Append(Open);
+		for (unsigned int TimeNum = 0; TimeNum < PieceCount; TimeNum++)
+			Output.Append(Pieces.GetElementAt(TimeNum));
+		if (Close != '\0')
+			Output.Append(Close);
+	}
+	EspString GetString()const
+	{
+		EspString Output;
+		GetString(Output);
+		return Output;
+	}
+	//Writes the pieces straight from their buffers, with writev where available; returns false on a write error
+	bool WriteToFile(int FileDescriptor)const
+	{
+#if defined(_WIN32)
+		if (Open != '\0' && !EspJsonParallelWriter::WriteAll(FileDescriptor, &Open, 1))
+			return false;
+		for (unsigned int TimeNum = 0; TimeNum < PieceCount; TimeNum++)
+			if (!EspJsonParallelWriter::WriteAll(FileDescriptor, Pieces.GetElementAt(TimeNum).GetAnsiStr(), Pieces.GetElementAt(TimeNum).GetLength()))
+				return false;
+		return Close == '\0' || EspJsonParallelWriter::WriteAll(FileDescriptor, &Close, 1);
+#else
+		EspArray<struct iovec> Vectors;
+		Vectors.Reserve(PieceCount + 2);
+		struct iovec Vector;
+		if (Open != '\0')
+		{
+			Vector.iov_base = (void*)&Open;
+			Vector.iov_len = 1;
+			Vectors.AddElement(Vector);
+		}
+		for (unsigned int TimeNum = 0; TimeNum < PieceCount; TimeNum++)
+			if (Pieces.GetElementAt(TimeNum).GetLength() > 0)
+			{
+				Vector.iov_base = (void*)Pieces.GetElementAt(TimeNum).GetAnsiStr();
+				Vector.iov_len = Pieces.GetElementAt(TimeNum).GetLength();
+				Vectors.AddElement(Vector);
+			}
+		if (Close != '\0')
+		{
+			Vector.iov_base = (void*)&Close;
+			Vector.iov_len = 1;
+			Vectors.AddElement(Vector);
+		}
+		struct iovec* Pending = Vectors.GetBuffer();
+		unsigned int PendingCount = Vectors.GetCount();
+		while (PendingCount > 0)
+		{
+			ssize_t Written = ::writev(FileDescriptor, Pending, PendingCount < IOV_MAX ? PendingCount : IOV_MAX);
+			if (Written < 0)
+				return false;
+			//Skip what was fully written and trim a partially written buffer
+			while (PendingCount > 0 && (size_t)Written >= Pending->iov_len)
+			{
+				Written -= Pending->iov_len;
+				Pending++;
+				PendingCount--;
+			}
+			if (PendingCount > 0)
+			{
+				Pending->iov_base = (char*)Pending->iov_base + Written;
+				Pending->iov_len -= Written;
+			}
+		}
+		return true;
+#endif
+	}
+};
+
+//Same text as the sequential EspJsonWriter, produced on the pool
+inline EspString EspParallelSynthesize(const EspJsonValue& Value, unsigned int Grain = 0, EspThreadPool& Pool = EspThreadPool::GetDefault())
+{
+	EspJsonParallelWriter Writer;
+	Writer.Write(Value, Grain, Pool);
+	return Writer.GetString();
+}
+inline EspString EspParallelSynthesize(const EspJsonArray& JsonArray, unsigned int Grain = 0, EspThreadPool& Pool = EspThreadPool::GetDefault())
+{
+	EspJsonParallelWriter Writer;
+	Writer.Write(JsonArray, Grain, Pool);
+	return Writer.GetString();
+}
+inline EspString EspParallelSynthesize(const EspJsonObject& JsonObject, unsigned int Grain = 0, EspThreadPool& Pool = EspThreadPool::GetDefault())
+{
+	EspJsonParallelWriter Writer;
+	Writer.Write(JsonObject, Grain, Pool);
+	return Writer.GetString();
+}
@@ -3,6 +3,15 @@
 #include"EspString.hpp"
 #include"EspArray.hpp"
 #include<Windows.h>
+#include<atomic>
+#include<mutex>
+#if defined(_MSC_VER)
+#include<intrin.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include<emmintrin.h>
+#define __ESPJSONPARSER_SSE2__
+#endif
 enum class EspJsonValueType { Value_Void, Value_Null, Value_Boolean, Value_Number, Value_String, Value_Object, Value_Array };
 enum class EspJsonErrorCode
 {
@@ -14,20 +23,74 @@ enum class EspJsonErrorCode
 	Error_Miss_Comma,
 	Error_Miss_Colon,
 	Error_Miss_Brace,
-	Error_Miss_Bracket
+	Error_Miss_Bracket,
+	Error_Depth_Exceeded
 };
 class EspJsonValue;
 class EspJsonMember;
 class EspJsonParser;
 class EspJsonObject;
 class EspJsonArray;
+class EspJsonTapeValue;
+struct EspJsonBindingReader;
+//Strings, objects and arrays are reference counted: copying an EspJsonValue shares the payload, and the first
+//non-const access (GetJsonObject, GetJsonArray, SetString...) through a shared value copies one level first.
+template<class EspType>
+struct EspJsonShared
+{
+	std::atomic<unsigned int> RefCount;
+	EspType Value;
+	EspJsonShared(const EspType& Value) :RefCount(1), Value(Value) {}
+};
 class EspJsonValue
 {
 private:
 	EspJsonValueType ValueType = EspJsonValueType::Value_Void;
-	void* ValuePointer = nullptr;
+	//Booleans and numbers live inline; only strings, objects and arrays are allocated
+	union
+	{
+		bool BooleanValue;
+		double NumberValue;
+		void* ValuePointer = nullptr;
+	};
 
+	template<class EspType>
+	EspType& GetShared()const { return ((EspJsonShared<EspType>*)this->ValuePointer)->Value; }
+	template<class EspType>
+	void SetShared(EspJsonValueType NewType, const EspType& NewValue)
+	{
+		//Allocate before releasing, NewValue may live inside the current payload
+		void* NewPointer = new EspJsonShared<EspType>(NewValue);
+		this->PreFreeValue();
+		this->ValueType = NewType;
+		this->ValuePointer = NewPointer;
+	}
+	template<class EspType>
+	void AddRef()const { ((EspJsonShared<EspType>*)this->ValuePointer)->RefCount.fetch_add(1, std::memory_order_relaxed); }
+	template<class EspType>
+	void Release()const
+	{
+		EspJsonShared<EspType>* Shared = (EspJsonShared<EspType>*)this->ValuePointer;
+		if (Shared->RefCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			delete Shared;
+	}
+	//Gives this value its own copy of a shared payload; nested values are shared by the copy, not duplicated
+	template<class EspType>
+	EspType& Detach()
+	{
+		EspJsonShared<EspType>* Shared = (EspJsonShared<EspType>*)this->ValuePointer;
+		if (Shared->RefCount.load(std::memory_order_acquire) != 1)
+		{
+			this->ValuePointer = new EspJsonShared<EspType>(Shared->Value);
+			if (Shared->RefCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+				delete Shared;
+		}
+		return this->GetShared<EspType>();
+	}
+	void CopyValue(const EspJsonValue& NewValue);
+	void ReleaseTree()const;
 public:
+	typedef void EspRelocatable;
 	EspJsonValue() {}
 	EspJsonValue(EspJsonValueType ValueType, void* ValuePointer);
 	EspJsonValue(const bool& BooleanValue);
@@ -36,6 +99,7 @@ public:
 	EspJsonValue(const EspJsonObject& JsonObject);
 	EspJsonValue(const EspJsonArray& JsonArray);
 	EspJsonValue(const EspJsonValue& NewValue);
+	EspJsonValue(EspJsonValue&& NewValue);
 	~EspJsonValue()
 	{
 		this->PreFreeValue();
@@ -55,6 +119,10 @@ public:
 	const EspString& GetString()const;
 	EspJsonObject& GetJsonObject();
 	EspJsonArray& GetJsonArray();
+	const EspJsonObject& GetJsonObject()const;
+	const EspJsonArray& GetJsonArray()const;
+	//Number of values sharing this payload; 0 for inline scalars
+	unsigned int GetShareCount()const;
 	void SetBoolean(const bool& NewValue);
 	void SetNull();
 	void SetNumber(const double& NewValue);
@@ -63,8 +131,11 @@ public:
 	void SetJsonArray(const EspJsonArray& JsonArray);
 	void PreFreeValue()const;
 	const EspJsonValue& operator=(const EspJsonValue& NewValue);
+	const EspJsonValue& operator=(EspJsonValue&& NewValue);
 	EspJsonValue& operator[](const EspString& Key);
 	EspJsonValue& operator[](const unsigned int Index);
+	const EspJsonValue& operator[](const EspString& Key)const;
+	const EspJsonValue& operator[](const unsigned int Index)const;
 };
 class EspJsonMember
 {
@@ -72,6 +143,7 @@ private:
 	EspString Key;
 	EspJsonValue Value;
 public:
+	typedef void EspRelocatable;
 	EspJsonMember() {}
 	EspJsonMember(const EspString& Key, const EspJsonValue& Value)
 	{
@@ -84,8 +156,10 @@ public:
 		this->Value = Member.Value;
 	}
 	EspString& GetKey() { return Key; }
+	const EspString& GetKey()const { return Key; }
 	void SetKey(const EspString& Key) { this->Key = Key; }
 	EspJsonValue& GetValue() { return Value; }
+	const EspJsonValue& GetValue()const { return Value; }
 	void SetValue(const EspJsonValue& Value) { this->Value = Value; }
 	//	const EspJsonMember& operator=(const EspJsonMember& NewMember)
 };
@@ -93,7 +167,7 @@ public:
 class EspJsonObject
 {
 private:
-	EspArray<EspJsonMember> JsonObject;
+	EspSmallArray<EspJsonMember, 8> JsonObject;
 public:
 	EspJsonObject() {}
 	EspJsonObject(const EspJsonObject& JsonObject)
@@ -108,10 +182,12 @@ public:
 			if (this->JsonObject.GetElementAt(TimeNum).GetKey().Compare(Key))
 				return JsonObject.GetElementAt(TimeNum).GetValue();
 	}
+	const EspJsonValue& GetValue(const EspString& Key)const { return const_cast<EspJsonObject*>(this)->GetValue(Key); }
 	EspJsonMember& GetMember(const unsigned int Index)
 	{
 		return this->JsonObject.GetElementAt(Index);
 	}
+	const EspJsonMember& GetMember(const unsigned int Index)const { return this->JsonObject.GetElementAt(Index); }
 	void SetValue(const EspString& Key, const EspJsonValue& Value)
 	{
 		for (unsigned int TimeNum = 0; TimeNum < this->JsonObject.GetCount(); TimeNum++)
@@ -130,13 +206,14 @@ public:
 	void DeleteAll() { this->JsonObject.Empty(); }
 	unsigned int GetCount()const { return this->JsonObject.GetCount(); }
 	EspJsonValue& operator[](const EspString& Key) { return this->GetValue(Key); }
+	const EspJsonValue& operator[](const EspString& Key)const { return this->GetValue(Key); }
 
 	EspString Synthesize()const;
 };
 class EspJsonArray
 {
 private:
-	EspArray<EspJsonValue> JsonArray;
+	EspSmallArray<EspJsonValue, 8> JsonArray;
 public:
 	EspJsonArray() {}
 	EspJsonArray(const EspJsonArray& JsonArray)
@@ -146,610 +223,1241 @@ public:
 	}
 	void AddValue(const EspJsonValue& JsonValue) { this->JsonArray.AddElement(JsonValue); }
 	EspJsonValue& GetValue(const unsigned int Index) { return this->JsonArray.GetElementAt(Index); }
+	const EspJsonValue& GetValue(const unsigned int Index)const { return this->JsonArray.GetElementAt(Index); }
 	void SetValue(const unsigned int Index, const EspJsonValue& JsonValue) { this->JsonArray.SetElementAt(Index, JsonValue); }
 	void DeleteValue(const unsigned int Index) { this->JsonArray.DeleteElement(Index, 1); }
 	void DeleteAll() { this->JsonArray.Empty(); }
 	unsigned int GetCount()const { return this->JsonArray.GetCount(); }
 	EspJsonValue& operator[](const unsigned int Index) { return this->GetValue(Index); }
+	const EspJsonValue& operator[](const unsigned int Index)const { return this->GetValue(Index); }
 
 	EspString Synthesize()const;
 };
 
-class EspJsonParser
+//Read-only document in one array of 64-bit words: the top byte is a tag, the low 56 bits a payload.
+//  'n' 't' 'f'  null/true/false
+//  'd'          number; the next word holds the double's bits
+//  's'          string; payload is the offset in the string arena of a 4-byte length, the bytes and a terminator
+//  'S'          string decoded in place in the parsed buffer (ParseTapeInSitu); payload is its offset, the next word its length
+//  '{' '['      payload bits 0-31 = index just past the matching close word, bits 32-55 = element count (saturated)
+//  '}' ']'      payload = index of the matching open word
+//Object members are a key string word followed by the value, so skipping any value is O(1).
+class EspJsonTape
 {
+	friend class EspJsonTapeValue;
+	friend class EspJsonParser;
 private:
-	EspString JsonString;
-	unsigned int ParsePos = 0;
-	EspJsonErrorCode ErrorCode = EspJsonErrorCode::Error_NoError;
+	EspArray<unsigned long long> Words;
+	EspArray<char> Strings;
+	const char* Source = nullptr;
 
-	void ParseValue_Boolean_True(EspJsonValue& JsonValue)
+	static unsigned long long MakeWord(char Tag, unsigned long long Payload) { return ((unsigned long long)(unsigned char)Tag << 56) | Payload; }
+	void AddWord(char Tag, unsigned long long Payload = 0) { Words.AddElement(EspJsonTape::MakeWord(Tag, Payload)); }
+	void AddNumber(double Number)
 	{
-		//std::cout << "[" << this->ParsePos << "]";
-		if (this->JsonString.GetCharAt(this->ParsePos++) == 't' &&
-			this->JsonString.GetCharAt(this->ParsePos++) == 'r' &&
-			this->JsonString.GetCharAt(this->ParsePos++) == 'u' &&
-			this->JsonString.GetCharAt(this->ParsePos++) == 'e')
-			JsonValue.SetBoolean(true);
-		else
-			this->ErrorCode = EspJsonErrorCode::Error_Invalid_Character;
-		//std::cout << "Value: " << "[Boolean] " << "true" << std::endl;
+		unsigned long long Bits;
+		::memcpy(&Bits, &Number, sizeof(Bits));
+		AddWord('d');
+		Words.AddElement(Bits);
 	}
-	void ParseValue_Boolean_False(EspJsonValue& JsonValue)
+	void AddString(const char* lpszStr, unsigned int nLength)
 	{
-		//std::cout << "[" << this->ParsePos << "]";
-		if (this->JsonString.GetCharAt(this->ParsePos++) == 'f' &&
-			this->JsonString.GetCharAt(this->ParsePos++) == 'a' &&
-			this->JsonString.GetCharAt(this->ParsePos++) == 'l' &&
-			this->JsonString.GetCharAt(this->ParsePos++) == 's' &&
-			this->JsonString.GetCharAt(this->ParsePos++) == 'e')
-			JsonValue.SetBoolean(false);
-		else
-			this->ErrorCode = EspJsonErrorCode::Error_Invalid_Character;
-		//std::cout << "Value: " << "[Boolean] " << "false" << std::endl;
+		AddWord('s', Strings.GetCount());
+		Strings.InsertRange(Strings.GetCount(), (const char*)&nLength, (const char*)&nLength + sizeof(nLength));
+		if (nLength > 0)
+			Strings.InsertRange(Strings.GetCount(), lpszStr, lpszStr + nLength);
+		Strings.AddElement('\0');
 	}
-	void ParseValue_Null(EspJsonValue& JsonValue)
+	void AddSourceString(unsigned int Offset, unsigned int nLength)
 	{
-		//std::cout << "[" << this->ParsePos << "]";
-		if (this->JsonString.GetCharAt(this->ParsePos++) == 'n' &&
-			this->JsonString.GetCharAt(this->ParsePos++) == 'u' &&
-			this->JsonString.GetCharAt(this->ParsePos++) == 'l' &&
-			this->JsonString.GetCharAt(this->ParsePos++) == 'l')
-			JsonValue.SetNull();
-		else
-			this->ErrorCode = EspJsonErrorCode::Error_Invalid_Character;
-		//std::cout << "Value: " << "[Null] " << "null" << std::endl;
+		AddWord('S', Offset);
+		Words.AddElement(nLength);
+	}
+	unsigned int OpenContainer(char Tag)
+	{
+		AddWord(Tag);
+		return Words.GetCount() - 1;
+	}
+	void CloseContainer(unsigned int Start, char Tag, unsigned int Count)
+	{
+		AddWord(Tag, Start);
+		Words.GetElementAt(Start) |= (unsigned long long)(Count < 0xFFFFFF ? Count : 0xFFFFFF) << 32 | Words.GetCount();
+	}
+
+public:
+	char GetTag(unsigned int Index)const { return (char)(Words.GetElementAt(Index) >> 56); }
+	unsigned long long GetPayload(unsigned int Index)const { return Words.GetElementAt(Index) & 0x00FFFFFFFFFFFFFFull; }
+	unsigned int GetWordCount()const { return Words.GetCount(); }
+	unsigned int GetStringArenaSize()const { return Strings.GetCount(); }
+	bool IsEmpty()const { return Words.IsEmpty(); }
+	//Non-NULL when the strings live in a buffer that was parsed in place; that buffer must outlive the tape
+	const char* GetSource()const { return Source; }
+	void Empty()
+	{
+		Words.Empty();
+		Strings.Empty();
+		Source = NULL;
 	}
-	void ParseValue_Number(EspJsonValue& JsonValue)
+	EspJsonTapeValue GetRoot()const;
+};
+
+//A position in an EspJsonTape; copying it is free and it stays valid as long as the tape is unchanged.
+//Lookups that miss return a Void value instead of asserting, so chained operator[] calls are safe.
+class EspJsonTapeValue
+{
+private:
+	const EspJsonTape* Tape = nullptr;
+	unsigned int Index = -1;
+
+	char GetTag()const { return IsVoid() ? '\0' : Tape->GetTag(Index); }
+	//Index of the word after this value
+	unsigned int GetNextIndex()const
 	{
-		//std::cout << "[" << this->ParsePos << "]";
-		EspString NumberValue;
-		if (this->JsonString.GetCharAt(this->ParsePos) == '-')
+		switch (GetTag())
 		{
-			NumberValue.Append('-');
-			this->ParsePos++;
+		case 'd':case 'S':return Index + 2;
+		case '{':case '[':return (unsigned int)Tape->GetPayload(Index);
+		default:return Index + 1;
 		}
-		if (this->JsonString.GetCharAt(this->ParsePos) == '0')
+	}
+
+public:
+	EspJsonTapeValue() {}
+	EspJsonTapeValue(const EspJsonTape* Tape, unsigned int Index) :Tape(Tape), Index(Index) {}
+
+	EspJsonValueType GetValueType()const
+	{
+		switch (GetTag())
 		{
-			NumberValue.Append('0');
-			this->ParsePos++;
+		case 'n':return EspJsonValueType::Value_Null;
+		case 't':case 'f':return EspJsonValueType::Value_Boolean;
+		case 'd':return EspJsonValueType::Value_Number;
+		case 's':case 'S':return EspJsonValueType::Value_String;
+		case '{':return EspJsonValueType::Value_Object;
+		case '[':return EspJsonValueType::Value_Array;
+		default:return EspJsonValueType::Value_Void;
 		}
-		else
+	}
+	bool IsVoid()const { return Tape == nullptr || Index >= Tape->GetWordCount(); }
+	bool IsNull()const { return GetTag() == 'n'; }
+	bool IsBoolean()const { return GetTag() == 't' || GetTag() == 'f'; }
+	bool IsNumber()const { return GetTag() == 'd'; }
+	bool IsString()const { return GetTag() == 's' || GetTag() == 'S'; }
+	bool IsObject()const { return GetTag() == '{'; }
+	bool IsArray()const { return GetTag() == '['; }
+
+	bool GetBoolean()const
+	{
+		assert(IsBoolean());
+		return GetTag() == 't';
+	}
+	double GetNumber()const
+	{
+		assert(IsNumber());
+		unsigned long long Bits = Tape->Words.GetElementAt(Index + 1);
+		double Number;
+		::memcpy(&Number, &Bits, sizeof(Number));
+		return Number;
+	}
+	unsigned int GetStringLength()const
+	{
+		assert(IsString());
+		if (GetTag() == 'S')
+			return (unsigned int)Tape->Words.GetElementAt(Index + 1);
+		unsigned int Length;
+		::memcpy(&Length, Tape->Strings.GetBuffer() + Tape->GetPayload(Index), sizeof(Length));
+		return Length;
+	}
+	//Null-terminated; may contain embedded zeros, use GetStringLength()
+	const char* GetStringData()const
+	{
+		assert(IsString());
+		if (GetTag() == 'S')
+			return Tape->Source + Tape->GetPayload(Index);
+		return Tape->Strings.GetBuffer() + Tape->GetPayload(Index) + sizeof(unsigned int);
+	}
+	EspString GetString()const
+	{
+		EspString Result;
+		unsigned int Length = GetStringLength();
+		if (Length > 0)
+			::memcpy(Result.GetBufferSetLength(Length), GetStringData(), Length);
+		return Result;
+	}
+
+	//Number of members or elements
+	unsigned int GetCount()const
+	{
+		assert(IsObject() || IsArray());
+		unsigned int Count = (unsigned int)(Tape->GetPayload(Index) >> 32);
+		if (Count < 0xFFFFFF)
+			return Count;
+		Count = 0;
+		for (unsigned int Pos = Index + 1; Tape->GetTag(Pos) != (IsObject() ? '}' : ']'); Count++)
 		{
-			if (!(this->JsonString.GetCharAt(this->ParsePos) >= '1' && this->JsonString.GetCharAt(this->ParsePos) <= '9'))
+			//Keys are strings and take two words when they point into the source
+			if (IsObject())
+				Pos = EspJsonTapeValue(Tape, Pos).GetNextIndex();
+			Pos = EspJsonTapeValue(Tape, Pos).GetNextIndex();
+		}
+		return Count;
+	}
+	//The next value in the enclosing container, or Void past the last one; O(1) for every type
+	EspJsonTapeValue GetNextSibling()const
+	{
+		if (IsVoid())
+			return EspJsonTapeValue();
+		unsigned int Next = GetNextIndex();
+		char Tag = Next < Tape->GetWordCount() ? Tape->GetTag(Next) : '\0';
+		if (Tag == '}' || Tag == ']' || Tag == '\0')
+			return EspJsonTapeValue();
+		return EspJsonTapeValue(Tape, Next);
+	}
+	//First element of an array, or first key of an object (the member's value is its next sibling)
+	EspJsonTapeValue GetFirstChild()const
+	{
+		if (IsVoid() || (!IsObject() && !IsArray()))
+			return EspJsonTapeValue();
+		char Tag = Tape->GetTag(Index + 1);
+		return Tag == '}' || Tag == ']' ? EspJsonTapeValue() : EspJsonTapeValue(Tape, Index + 1);
+	}
+	EspJsonTapeValue GetValue(const char* lpszKey, unsigned int nLength)const
+	{
+		if (!IsObject())
+			return EspJsonTapeValue();
+		for (EspJsonTapeValue Key = GetFirstChild(); !Key.IsVoid(); Key = Key.GetNextSibling().GetNextSibling())
+			if (Key.GetStringLength() == nLength && ::memcmp(Key.GetStringData(), lpszKey, nLength) == 0)
+				return Key.GetNextSibling();
+		return EspJsonTapeValue();
+	}
+	EspJsonTapeValue GetValue(const unsigned int Index)const
+	{
+		if (!IsArray())
+			return EspJsonTapeValue();
+		EspJsonTapeValue Element = GetFirstChild();
+		for (unsigned int TimeNum = 0; TimeNum < Index && !Element.IsVoid(); TimeNum++)
+			Element = Element.GetNextSibling();
+		return Element;
+	}
+	EspJsonTapeValue operator[](const EspString& Key)const { return GetValue(Key.GetAnsiStr(), Key.GetLength()); }
+	EspJsonTapeValue operator[](const char* Key)const { return GetValue(Key, EspString::GetLength(Key)); }
+	EspJsonTapeValue operator[](const unsigned int Index)const { return GetValue(Index); }
+	EspJsonTapeValue operator[](const int Index)const { return GetValue((unsigned int)Index); }
+};
+inline EspJsonTapeValue EspJsonTape::GetRoot()const { return EspJsonTapeValue(this, Words.IsEmpty() ? -1 : 0); }
+
+class EspJsonParser
+{
+	friend struct EspJsonBindingReader;
+private:
+	//Receives the values of a document in order; Add* calls after AddKey belong to that key
+	class EspJsonTreeBuilder
+	{
+	private:
+		struct EspJsonTreeFrame
+		{
+			EspJsonValue Container;
+			EspString Key;
+		};
+		//Frames above Depth are kept so their key buffers are reused by the next container
+		EspArray<EspJsonTreeFrame> Frames;
+		unsigned int Depth = 0;
+
+		void AddValue(const EspJsonValue& Value)
+		{
+			if (Depth == 0)
 			{
-				this->ErrorCode = EspJsonErrorCode::Error_Invalid_Number;
+				Root = Value;
 				return;
 			}
-			while (this->JsonString.GetCharAt(this->ParsePos) >= '0' && this->JsonString.GetCharAt(this->ParsePos) <= '9')
+			EspJsonTreeFrame& Top = Frames.GetElementAt(Depth - 1);
+			if (Top.Container.IsObject())
+				Top.Container.GetJsonObject().AddMember(EspJsonMember(Top.Key, Value));
+			else
+				Top.Container.GetJsonArray().AddValue(Value);
+		}
+	public:
+		EspJsonValue Root;
+
+		void Reset()
+		{
+			Root = EspJsonValue();
+			for (; Depth > 0; Depth--)
+				Frames.GetElementAt(Depth - 1).Container = EspJsonValue();
+		}
+		void AddNull() { AddValue(EspJsonValue(EspJsonValueType::Value_Null, NULL)); }
+		void AddBoolean(bool BooleanValue) { AddValue(EspJsonValue(BooleanValue)); }
+		void AddNumber(double NumberValue) { AddValue(EspJsonValue(NumberValue)); }
+		void AddString(const EspString& StringValue) { AddValue(EspJsonValue(StringValue)); }
+		void AddKey(const EspString& Key) { Frames.GetElementAt(Depth - 1).Key = Key; }
+		void OpenContainer(char Tag)
+		{
+			if (Depth == Frames.GetCount())
+				Frames.AddElement(EspJsonTreeFrame());
+			EspJsonTreeFrame& Top = Frames.GetElementAt(Depth++);
+			if (Tag == '{')
+				Top.Container.SetJsonObject(EspJsonObject());
+			else
+				Top.Container.SetJsonArray(EspJsonArray());
+		}
+		void CloseContainer(char)
+		{
+			EspJsonValue Value(std::move(Frames.GetElementAt(--Depth).Container));
+			AddValue(Value);
+		}
+	};
+	class EspJsonTapeBuilder
+	{
+	private:
+		struct EspJsonTapeFrame
+		{
+			unsigned int Start;
+			unsigned int Count;
+		};
+		EspArray<EspJsonTapeFrame> Frames;
+
+		void CountValue()
+		{
+			if (!Frames.IsEmpty())
+				Frames.GetElementAt(Frames.GetCount() - 1).Count++;
+		}
+	public:
+		EspJsonTape* Tape = nullptr;
+
+		void Reset() { Frames.Empty(); }
+		void AddNull() { CountValue(); Tape->AddWord('n'); }
+		void AddBoolean(bool BooleanValue) { CountValue(); Tape->AddWord(BooleanValue ? 't' : 'f'); }
+		void AddNumber(double NumberValue) { CountValue(); Tape->AddNumber(NumberValue); }
+		void AddString(const EspString& StringValue) { CountValue(); Tape->AddString(StringValue.GetAnsiStr(), StringValue.GetLength()); }
+		void AddKey(const EspString& Key) { Tape->AddString(Key.GetAnsiStr(), Key.GetLength()); }
+		void AddSourceString(unsigned int Offset, unsigned int Length) { CountValue(); Tape->AddSourceString(Offset, Length); }
+		void AddSourceKey(unsigned int Offset, unsigned int Length) { Tape->AddSourceString(Offset, Length); }
+		void OpenContainer(char Tag)
+		{
+			CountValue();
+			EspJsonTapeFrame Frame = { Tape->OpenContainer(Tag), 0 };
+			Frames.AddElement(Frame);
+		}
+		void CloseContainer(char Tag)
+		{
+			EspJsonTapeFrame Frame = Frames.GetElementAt(Frames.GetCount() - 1);
+			Frames.DeleteElement(Frames.GetCount() - 1);
+			Tape->CloseContainer(Frame.Start, Tag, Frame.Count);
+		}
+	};
+
+	EspString JsonString;
+	//What is being parsed: JsonString's buffer, or the caller's buffer during ParseTapeInSitu
+	const char* Input = nullptr;
+	unsigned int InputLength = 0;
+	char* InSituBuffer = nullptr;
+	EspString ValueScratch;
+	EspString NumberScratch;
+	unsigned int ParsePos = 0;
+	EspJsonErrorCode ErrorCode = EspJsonErrorCode::Error_NoError;
+	//One '{' or '[' per open container; the parser never recurses, so deep documents only cost heap memory
+	EspArray<char> ContainerStack;
+	unsigned int MaxDepth = 1024;
+	//Nesting of bound structs and arrays during ParseStruct, which does recurse
+	unsigned int StructDepth = 0;
+	EspJsonTreeBuilder TreeBuilder;
+	EspJsonTapeBuilder TapeBuilder;
+
+	//'\0' past the end, which no token accepts
+	char GetChar()const { return this->ParsePos < this->InputLength ? this->Input[this->ParsePos] : '\0'; }
+	void SetInput(const char* lpszInput, unsigned int nLength)
+	{
+		this->Input = lpszInput;
+		this->InputLength = nLength;
+		this->ParsePos = 0;
+		this->ErrorCode = EspJsonErrorCode::Error_NoError;
+	}
+	bool ParseLiteral(const char* lpszLiteral)
+	{
+		for (; *lpszLiteral != '\0'; lpszLiteral++, this->ParsePos++)
+			if (this->GetChar() != *lpszLiteral)
 			{
-				NumberValue.Append(this->JsonString.GetCharAt(this->ParsePos));
-				this->ParsePos++;
+				this->ErrorCode = EspJsonErrorCode::Error_Invalid_Character;
+				return false;
 			}
+		return true;
+	}
+	bool ParseNumber(double& Number)
+	{
+		unsigned int Start = this->ParsePos;
+		if (this->GetChar() == '-')
+			this->ParsePos++;
+		if (this->GetChar() == '0')
+			this->ParsePos++;
+		else
+		{
+			if (!(this->GetChar() >= '1' && this->GetChar() <= '9'))
+			{
+				this->ErrorCode = EspJsonErrorCode::Error_Invalid_Number;
+				return false;
+			}
+			while (this->GetChar() >= '0' && this->GetChar() <= '9')
+				this->ParsePos++;
 		}
-		if (this->JsonString.GetCharAt(this->ParsePos) == '.')
+		if (this->GetChar() == '.')
 		{
-			NumberValue.Append('.');
 			this->ParsePos++;
-			if (!(this->JsonString.GetCharAt(this->ParsePos) >= '0' && this->JsonString.GetCharAt(this->ParsePos) <= '9'))
+			if (!(this->GetChar() >= '0' && this->GetChar() <= '9'))
 			{
 				this->ErrorCode = EspJsonErrorCode::Error_Invalid_Number;
 			}
-			while (this->JsonString.GetCharAt(this->ParsePos) >= '0' && this->JsonString.GetCharAt(this->ParsePos) <= '9')
-			{
-				NumberValue.Append(this->JsonString.GetCharAt(this->ParsePos));
+			while (this->GetChar() >= '0' && this->GetChar() <= '9')
 				this->ParsePos++;
-			}
 		}
-		if (this->JsonString.GetCharAt(this->ParsePos) == 'e' || this->JsonString.GetCharAt(this->ParsePos) == 'E')
+		if (this->GetChar() == 'e' || this->GetChar() == 'E')
 		{
-			NumberValue.Append(this->JsonString.GetCharAt(this->ParsePos));
 			this->ParsePos++;
-			if (this->JsonString.GetCharAt(this->ParsePos) == '+' || this->JsonString.GetCharAt(this->ParsePos) == '-')
-			{
-				NumberValue.Append(this->JsonString.GetCharAt(this->ParsePos));
+			if (this->GetChar() == '+' || this->GetChar() == '-')
 				this->ParsePos++;
-			}
-			if (!(this->JsonString.GetCharAt(this->ParsePos) >= '0' && this->JsonString.GetCharAt(this->ParsePos) <= '9'))
+			if (!(this->GetChar() >= '0' && this->GetChar() <= '9'))
 			{
 				this->ErrorCode = EspJsonErrorCode::Error_Invalid_Number;
-				return;
+				return false;
 			}
-			while (this->JsonString.GetCharAt(this->ParsePos) >= '0' && this->JsonString.GetCharAt(this->ParsePos) <= '9')
-			{
-				NumberValue.Append(this->JsonString.GetCharAt(this->ParsePos));
+			while (this->GetChar() >= '0' && this->GetChar() <= '9')
 				this->ParsePos++;
-			}
 		}
-		JsonValue.SetNumber(::strtod(NumberValue.GetAnsiStr(), NULL));
-		//std::cout << "Value: " << "[Number] " << NumberValue.GetAnsiStr() << std::endl;
+		//strtod would read past the JSON grammar (hex, inf...), so it gets a copy of just the validated text
+		this->NumberScratch.Assign(this->Input + Start, this->ParsePos - Start);
+		Number = ::strtod(this->NumberScratch.GetAnsiStr(), NULL);
+		return this->ErrorCode == EspJsonErrorCode::Error_NoError;
 	}
-	void ParseKey(EspString& Key)
+	static unsigned int CountTrailingZeros(unsigned int Mask)
 	{
-		//std::cout << "[" << this->ParsePos << "]";
-		if (this->JsonString.GetCharAt(this->ParsePos) != '"')
+#if defined(_MSC_VER)
+		unsigned long Index;
+		_BitScanForward(&Index, Mask);
+		return Index;
+#else
+		return __builtin_ctz(Mask);
+#endif
+	}
+	//First '"', '\\', '\r' or '\n' in [Pos, End), or End; everything before it can be copied as is
+	static const char* FindStringSpecial(const char* Pos, const char* End)
+	{
+#ifdef __ESPJSONPARSER_SSE2__
+		const __m128i Quote = _mm_set1_epi8('"');
+		const __m128i Backslash = _mm_set1_epi8('\\');
+		const __m128i Cr = _mm_set1_epi8('\r');
+		const __m128i Lf = _mm_set1_epi8('\n');
+		for (; End - Pos >= 16; Pos += 16)
 		{
-			this->ErrorCode = EspJsonErrorCode::Error_Miss_Quote;
-			return;
+			__m128i Block = _mm_loadu_si128((const __m128i*)Pos);
+			__m128i Special = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(Block, Quote), _mm_cmpeq_epi8(Block, Backslash)),
+				_mm_or_si128(_mm_cmpeq_epi8(Block, Cr), _mm_cmpeq_epi8(Block, Lf)));
+			unsigned int Mask = (unsigned int)_mm_movemask_epi8(Special);
+			if (Mask != 0)
+				return Pos + EspJsonParser::CountTrailingZeros(Mask);
 		}
-		Key.Empty();
-		while (true)
+#endif
+		while (Pos < End && *Pos != '"' && *Pos != '\\' && *Pos != '\r' && *Pos != '\n')
+			Pos++;
+		return Pos;
+	}
+	static bool ParseHex4(const char* Pos, const char* End, unsigned int& CodeUnit)
+	{
+		if (End - Pos < 4)
+			return false;
+		CodeUnit = 0;
+		for (unsigned int TimeNum = 0; TimeNum < 4; TimeNum++)
 		{
-			this->ParsePos++;
-			if (this->JsonString.GetCharAt(this->ParsePos) == '\\')
-			{
-				this->ParsePos++;
-				switch (this->JsonString.GetCharAt(this->ParsePos))
-				{
-				case'"':Key.Append('"'); break;
-				case'\\':Key.Append('\\'); break;
-				case'/':Key.Append('/'); break;
-				case'b':Key.Append('\b'); break;
-				case'f':Key.Append('\f'); break;
-				case'n':Key.Append('\n'); break;
-				case'r':Key.Append('\r'); break;
-				case't':Key.Append('\t'); break;
-				case'u':
-				{
-
-					break;
-				}
-				default:
-					this->ErrorCode = EspJsonErrorCode::Error_Invalid_Escape_Character;
-					return;
-				}
-			}
-			else if (this->JsonString.GetCharAt(this->ParsePos) == '"')
-			{
-				this->ParsePos++;
-				//std::cout << "Key: " << Key << std::endl;
-				return;
-			}
-			else if (this->JsonString.GetCharAt(this->ParsePos) == '\r' || this->JsonString.GetCharAt(this->ParsePos) == '\n')
+			char Digit = Pos[TimeNum];
+			CodeUnit <<= 4;
+			if (Digit >= '0' && Digit <= '9')
+				CodeUnit |= Digit - '0';
+			else if (Digit >= 'a' && Digit <= 'f')
+				CodeUnit |= Digit - 'a' + 10;
+			else if (Digit >= 'A' && Digit <= 'F')
+				CodeUnit |= Digit - 'A' + 10;
+			else
+				return false;
+		}
+		return true;
+	}
+	//Pos is at the 'u' of "\uXXXX"; a high surrogate must be followed by "\uXXXX" with the low one. Leaves Pos on the last hex digit.
+	static bool ParseUnicodeEscape(const char*& Pos, const char* End, unsigned int& CodePoint)
+	{
+		if (!EspJsonParser::ParseHex4(Pos + 1, End, CodePoint))
+			return false;
+		Pos += 4;
+		if (CodePoint >= 0xDC00 && CodePoint <= 0xDFFF)
+			return false;
+		if (CodePoint >= 0xD800 && CodePoint <= 0xDBFF)
+		{
+			unsigned int LowSurrogate;
+			if (End - Pos < 3 || Pos[1] != '\\' || Pos[2] != 'u' || !EspJsonParser::ParseHex4(Pos + 3, End, LowSurrogate) || LowSurrogate < 0xDC00 || LowSurrogate > 0xDFFF)
+				return false;
+			Pos += 6;
+			CodePoint = 0x10000 + ((CodePoint - 0xD800) << 10) + (LowSurrogate - 0xDC00);
+		}
+		return true;
+	}
+	//Writes 1 to 4 bytes, never more than the escape they came from
+	static unsigned int EncodeUtf8(unsigned int CodePoint, char* Utf8)
+	{
+		if (CodePoint < 0x80)
+		{
+			Utf8[0] = (char)CodePoint;
+			return 1;
+		}
+		if (CodePoint < 0x800)
+		{
+			Utf8[0] = (char)(0xC0 | (CodePoint >> 6));
+			Utf8[1] = (char)(0x80 | (CodePoint & 0x3F));
+			return 2;
+		}
+		if (CodePoint < 0x10000)
+		{
+			Utf8[0] = (char)(0xE0 | (CodePoint >> 12));
+			Utf8[1] = (char)(0x80 | ((CodePoint >> 6) & 0x3F));
+			Utf8[2] = (char)(0x80 | (CodePoint & 0x3F));
+			return 3;
+		}
+		Utf8[0] = (char)(0xF0 | (CodePoint >> 18));
+		Utf8[1] = (char)(0x80 | ((CodePoint >> 12) & 0x3F));
+		Utf8[2] = (char)(0x80 | ((CodePoint >> 6) & 0x3F));
+		Utf8[3] = (char)(0x80 | (CodePoint & 0x3F));
+		return 4;
+	}
+	//Decodes the escape whose backslash is just before Pos into Result and leaves Pos on its last character
+	static bool DecodeEscape(const char*& Pos, const char* End, char* Result, unsigned int& Length)
+	{
+		Length = 1;
+		switch (*Pos)
+		{
+		case'"':Result[0] = '"'; return true;
+		case'\\':Result[0] = '\\'; return true;
+		case'/':Result[0] = '/'; return true;
+		case'b':Result[0] = '\b'; return true;
+		case'f':Result[0] = '\f'; return true;
+		case'n':Result[0] = '\n'; return true;
+		case'r':Result[0] = '\r'; return true;
+		case't':Result[0] = '\t'; return true;
+		case'u':
+		{
+			unsigned int CodePoint;
+			if (!EspJsonParser::ParseUnicodeEscape(Pos, End, CodePoint))
+				return false;
+			Length = EspJsonParser::EncodeUtf8(CodePoint, Result);
+			return true;
+		}
+		default:
+			return false;
+		}
+	}
+	static bool IsWhitespace(char Char) { return Char == ' ' || Char == '\n' || Char == '\r' || Char == '\t'; }
+	//Compact input returns after one compare; runs of indentation are skipped 16 bytes at a time
+	void SkipWhitespace()
+	{
+		if (!EspJsonParser::IsWhitespace(this->GetChar()))
+			return;
+		const char* Pos = this->Input + this->ParsePos + 1;
+		const char* End = this->Input + this->InputLength;
+#ifdef __ESPJSONPARSER_SSE2__
+		const __m128i Space = _mm_set1_epi8(' ');
+		const __m128i Lf = _mm_set1_epi8('\n');
+		const __m128i Cr = _mm_set1_epi8('\r');
+		const __m128i Tab = _mm_set1_epi8('\t');
+		for (; End - Pos >= 16; Pos += 16)
+		{
+			__m128i Block = _mm_loadu_si128((const __m128i*)Pos);
+			__m128i Blank = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(Block, Space), _mm_cmpeq_epi8(Block, Lf)),
+				_mm_or_si128(_mm_cmpeq_epi8(Block, Cr), _mm_cmpeq_epi8(Block, Tab)));
+			unsigned int Mask = ~(unsigned int)_mm_movemask_epi8(Blank) & 0xFFFF;
+			if (Mask != 0)
 			{
-				this->ErrorCode = EspJsonErrorCode::Error_Invalid_Character;
+				this->ParsePos = (unsigned int)(Pos - this->Input) + EspJsonParser::CountTrailingZeros(Mask);
 				return;
 			}
-			else
-				Key.Append(this->JsonString.GetCharAt(this->ParsePos));
 		}
+#endif
+		while (Pos < End && EspJsonParser::IsWhitespace(*Pos))
+			Pos++;
+		this->ParsePos = (unsigned int)(Pos - this->Input);
 	}
-	void ParseValue_String(EspJsonValue& JsonValue)
+	//Moves ParsePos to a stop found by FindStringSpecial; true past a closing quote, false with ErrorCode set at
+	//the end of input or a line break, false without an error at a backslash
+	bool CheckStringStop(const char* Pos, const char* End)
 	{
-		//std::cout << "[" << this->ParsePos << "]";
-		if (this->JsonString.GetCharAt(this->ParsePos) != '"')
+		this->ParsePos = (unsigned int)(Pos - this->Input);
+		if (Pos == End)
+			this->ErrorCode = EspJsonErrorCode::Error_Miss_Quote;
+		else if (*Pos == '\r' || *Pos == '\n')
+			this->ErrorCode = EspJsonErrorCode::Error_Invalid_Character;
+		else if (*Pos == '"')
+		{
+			this->ParsePos++;
+			return true;
+		}
+		return false;
+	}
+	//Copies the runs between escapes in bulk, so a string without escapes costs one scan and one copy
+	void ParseKey(EspString& Key)
+	{
+		const char* End = this->Input + this->InputLength;
+		if (this->GetChar() != '"')
 		{
 			this->ErrorCode = EspJsonErrorCode::Error_Miss_Quote;
 			return;
 		}
-		EspString StringValue;
+		Key.Empty();
+		const char* Pos = this->Input + this->ParsePos + 1;
 		while (true)
 		{
-			this->ParsePos++;
-			if (this->JsonString.GetCharAt(this->ParsePos) == '\\')
-			{
-				this->ParsePos++;
-				switch (this->JsonString.GetCharAt(this->ParsePos))
-				{
-				case'"':StringValue.Append('"'); break;
-				case'\\':StringValue.Append('\\'); break;
-				case'/':StringValue.Append('/'); break;
-				case'b':StringValue.Append('\b'); break;
-				case'f':StringValue.Append('\f'); break;
-				case'n':StringValue.Append('\n'); break;
-				case'r':StringValue.Append('\r'); break;
-				case't':StringValue.Append('\t'); break;
-				case'u':
-				{
-
-					break;
-				}
-				default:
-					this->ErrorCode = EspJsonErrorCode::Error_Invalid_Escape_Character;
-					return;
-				}
-			}
-			else if (this->JsonString.GetCharAt(this->ParsePos) == '"')
-			{
-				this->ParsePos++;
-				JsonValue.SetString(StringValue);
-				//std::cout << "Value: " << "[String] " << (StringValue.IsEmpty()?"":StringValue.GetAnsiStr()) << std::endl;
+			const char* Stop = EspJsonParser::FindStringSpecial(Pos, End);
+			if (Stop > Pos)
+				Key.Append(Pos, (unsigned int)(Stop - Pos));
+			Pos = Stop;
+			if (this->CheckStringStop(Pos, End) || this->ErrorCode != EspJsonErrorCode::Error_NoError)
 				return;
-			}
-			else if (this->JsonString.GetCharAt(this->ParsePos) == '\r' || this->JsonString.GetCharAt(this->ParsePos) == '\n')
+			this->ParsePos++;
+			char Decoded[4];
+			unsigned int Length;
+			if (!EspJsonParser::DecodeEscape(++Pos, End, Decoded, Length))
 			{
-				this->ErrorCode = EspJsonErrorCode::Error_Invalid_Character;
+				this->ErrorCode = EspJsonErrorCode::Error_Invalid_Escape_Character;
 				return;
 			}
-			else
-				StringValue.Append(this->JsonString.GetCharAt(this->ParsePos));
+			Key.Append(Decoded, Length);
+			Pos++;
 		}
 	}
-	void ParseValue_JsonObject(EspJsonValue& JsonValue)
+	//Like ParseKey, but decodes into InSituBuffer over the string's own bytes and terminates it with '\0'
+	void ParseKeyInSitu(unsigned int& Offset, unsigned int& Length)
 	{
-		//std::cout << "[" << this->ParsePos << "]";
-		if (this->JsonString.GetCharAt(this->ParsePos) != '{')
-		{
-			this->ErrorCode = EspJsonErrorCode::Error_Miss_Brace;
-			return;
-		}
-		this->ParsePos++;
-		if (this->JsonString.GetCharAt(this->ParsePos) == '}')
+		const char* End = this->Input + this->InputLength;
+		if (this->GetChar() != '"')
 		{
-			this->ParsePos++;
-			JsonValue.SetJsonObject(EspJsonObject());
+			this->ErrorCode = EspJsonErrorCode::Error_Miss_Quote;
 			return;
 		}
-		EspJsonObject JsonObject;
-		//std::cout << "Value: " << "[Object] " << std::endl;
+		Offset = this->ParsePos + 1;
+		char* Dest = this->InSituBuffer + Offset;
+		const char* Pos = Dest;
 		while (true)
 		{
-			if (this->JsonString.GetCharAt(this->ParsePos) != '"')
+			const char* Stop = EspJsonParser::FindStringSpecial(Pos, End);
+			//Escapes only ever shrink, so the decoded text trails the input and never overwrites unread bytes
+			if (Dest != Pos)
+				::memmove(Dest, Pos, Stop - Pos);
+			Dest += Stop - Pos;
+			Pos = Stop;
+			if (this->CheckStringStop(Pos, End))
 			{
-				this->ErrorCode = EspJsonErrorCode::Error_Miss_Quote;
+				*Dest = '\0';
+				Length = (unsigned int)(Dest - (this->InSituBuffer + Offset));
 				return;
 			}
-			EspJsonMember JsonMember;
-			this->ParseKey(JsonMember.GetKey());
 			if (this->ErrorCode != EspJsonErrorCode::Error_NoError)
 				return;
-			//this->ParsePos++;
-			if (this->JsonString.GetCharAt(this->ParsePos) != ':')
-			{
-				this->ErrorCode = EspJsonErrorCode::Error_Miss_Colon;
-				return;
-			}
 			this->ParsePos++;
-			this->ParseValue(JsonMember.GetValue());
-			if (this->ErrorCode != EspJsonErrorCode::Error_NoError)
-				return;
-			JsonObject.AddMember(JsonMember);
-			if (this->JsonString.GetCharAt(this->ParsePos) == ',')
-				this->ParsePos++;
-			else if (this->JsonString.GetCharAt(this->ParsePos) == '}')
-			{
-				this->ParsePos++;
-				this->ErrorCode = EspJsonErrorCode::Error_NoError;
-				JsonValue.SetJsonObject(JsonObject);
-				return;
-			}
-			else
+			unsigned int DecodedLength;
+			if (!EspJsonParser::DecodeEscape(++Pos, End, Dest, DecodedLength))
 			{
-				this->ErrorCode = EspJsonErrorCode::Error_Miss_Comma;
+				this->ErrorCode = EspJsonErrorCode::Error_Invalid_Escape_Character;
 				return;
 			}
+			Dest += DecodedLength;
+			Pos++;
 		}
 	}
-	void ParseValue_JsonArray(EspJsonValue& JsonValue)
+	template<class BuilderType>
+	void ParseString(BuilderType& Builder, bool IsKey)
 	{
-		//std::cout << "[" << this->ParsePos << "]";
-		if (this->JsonString.GetCharAt(this->ParsePos) != '[')
+		this->ParseKey(this->ValueScratch);
+		if (this->ErrorCode != EspJsonErrorCode::Error_NoError)
+			return;
+		if (IsKey)
+			Builder.AddKey(this->ValueScratch);
+		else
+			Builder.AddString(this->ValueScratch);
+	}
+	void ParseString(EspJsonTapeBuilder& Builder, bool IsKey)
+	{
+		if (this->InSituBuffer == NULL)
 		{
-			this->ErrorCode = EspJsonErrorCode::Error_Miss_Bracket;
+			this->ParseKey(this->ValueScratch);
+			if (this->ErrorCode != EspJsonErrorCode::Error_NoError)
+				return;
+			if (IsKey)
+				Builder.AddKey(this->ValueScratch);
+			else
+				Builder.AddString(this->ValueScratch);
 			return;
 		}
-		this->ParsePos++;
-		if (this->JsonString.GetCharAt(this->ParsePos) == ']')
-		{
-			this->ParsePos++;
-			JsonValue.SetJsonArray(EspJsonArray());
+		unsigned int Offset, Length;
+		this->ParseKeyInSitu(Offset, Length);
+		if (this->ErrorCode != EspJsonErrorCode::Error_NoError)
 			return;
+		if (IsKey)
+			Builder.AddSourceKey(Offset, Length);
+		else
+			Builder.AddSourceString(Offset, Length);
+	}
+	template<class BuilderType>
+	bool ParseMemberKey(BuilderType& Builder)
+	{
+		this->SkipWhitespace();
+		if (this->GetChar() != '"')
+		{
+			this->ErrorCode = EspJsonErrorCode::Error_Miss_Quote;
+			return false;
 		}
-		EspJsonArray JsonArray;
-		//std::cout << "Value: " << "[Array] " <<  std::endl;
-		while (true)
+		this->ParseString(Builder, true);
+		if (this->ErrorCode != EspJsonErrorCode::Error_NoError)
+			return false;
+		this->SkipWhitespace();
+		if (this->GetChar() != ':')
 		{
-			EspJsonValue SubValue;
-			this->ParseValue(SubValue);
-			if (this->ErrorCode != EspJsonErrorCode::Error_NoError)
-				return;
-			JsonArray.AddValue(SubValue);
-			if (this->JsonString.GetCharAt(this->ParsePos) == ',')
-				this->ParsePos++;
-			else if (this->JsonString.GetCharAt(this->ParsePos) == ']')
-			{
-				this->ParsePos++;
-				JsonValue.SetJsonArray(JsonArray);
-				return;
-			}
-			else {
-				this->ErrorCode = EspJsonErrorCode::Error_Miss_Comma;
-				return;
-			}
+			this->ErrorCode = EspJsonErrorCode::Error_Miss_Colon;
+			return false;
 		}
+		this->ParsePos++;
+		return true;
 	}
-	void ParseValue(EspJsonValue& JsonValue)
+	//Parses one value of any type. Open containers are kept in ContainerStack instead of on the C++ stack:
+	//after each finished value the loop consumes the ',' or closing brackets that follow it.
+	template<class BuilderType>
+	void ParseDocument(BuilderType& Builder)
 	{
-		if (this->ErrorCode == EspJsonErrorCode::Error_NoError)
+		this->ContainerStack.Empty();
+		Builder.Reset();
+		while (this->ErrorCode == EspJsonErrorCode::Error_NoError)
 		{
-			switch (this->JsonString.GetCharAt(this->ParsePos))
+			bool Closing = false;
+			this->SkipWhitespace();
+			switch (this->GetChar())
 			{
-			case 't':this->ParseValue_Boolean_True(JsonValue); break;
-			case 'f':this->ParseValue_Boolean_False(JsonValue); break;
-			case 'n':this->ParseValue_Null(JsonValue); break;
+			case 't':if (this->ParseLiteral("true")) Builder.AddBoolean(true); break;
+			case 'f':if (this->ParseLiteral("false")) Builder.AddBoolean(false); break;
+			case 'n':if (this->ParseLiteral("null")) Builder.AddNull(); break;
 			case '0':case '1':case '2':case '3':case '4':case '5':
 			case '6':case '7':case '8':case '9':case '-':
-				this->ParseValue_Number(JsonValue); break;
-			case '"':this->ParseValue_String(JsonValue); break;
-			case '{':this->ParseValue_JsonObject(JsonValue); break;
-			case '[':this->ParseValue_JsonArray(JsonValue); break;
-			default:
-				this->ErrorCode = EspJsonErrorCode::Error_Invalid_Character;
+			{
+				double Number;
+				if (this->ParseNumber(Number))
+					Builder.AddNumber(Number);
 				break;
 			}
-		}
-	}
-public:
-	EspJsonParser(const EspString& JsonString) { this->JsonString = JsonString; }
-	EspJsonObject Parse()
-	{
-		if (this->JsonString.GetCharAt(this->ParsePos) != '{')
-		{
-			this->ErrorCode = EspJsonErrorCode::Error_Miss_Brace;
-			return EspJsonObject();
-		}
-		this->ParsePos++;
-		if (this->JsonString.GetCharAt(this->ParsePos) == '}')
-			return EspJsonObject();
-		EspJsonObject JsonObject;
-		while (true)
-		{
-			if (this->JsonString.GetCharAt(this->ParsePos) != '"')
+			case '"':this->ParseString(Builder, false); break;
+			case '{':case '[':
 			{
-				this->ErrorCode = EspJsonErrorCode::Error_Miss_Quote;
-				return EspJsonObject();
+				char Tag = this->GetChar();
+				if (this->ContainerStack.GetCount() >= this->MaxDepth)
+				{
+					this->ErrorCode = EspJsonErrorCode::Error_Depth_Exceeded;
+					break;
+				}
+				this->ContainerStack.AddElement(Tag);
+				Builder.OpenContainer(Tag);
+				this->ParsePos++;
+				this->SkipWhitespace();
+				if (this->GetChar() == (Tag == '{' ? '}' : ']'))
+				{
+					Closing = true;
+					break;
+				}
+				if (Tag == '{')
+					this->ParseMemberKey(Builder);
+				continue;
 			}
-			EspJsonMember JsonMember;
-			this->ParseKey(JsonMember.GetKey());
-			if (this->ErrorCode != EspJsonErrorCode::Error_NoError)
-				return EspJsonObject();
-			//this->ParsePos++;
-			if (this->JsonString.GetCharAt(this->ParsePos) != ':')
-			{
-				this->ErrorCode = EspJsonErrorCode::Error_Miss_Colon;
-				return EspJsonObject();
+			default:
+				this->ErrorCode = EspJsonErrorCode::Error_Invalid_Character;
+				break;
 			}
-			this->ParsePos++;
-			this->ParseValue(JsonMember.GetValue());
 			if (this->ErrorCode != EspJsonErrorCode::Error_NoError)
-				return EspJsonObject();
-			JsonObject.AddMember(JsonMember);
-			if (this->JsonString.GetCharAt(this->ParsePos) == ',')
-				this->ParsePos++;
-			else if (this->JsonString.GetCharAt(this->ParsePos) == '}')
-			{
-				this->ErrorCode = EspJsonErrorCode::Error_NoError;
-				return JsonObject;
-			}
-			else
+				break;
+			while (!this->ContainerStack.IsEmpty())
 			{
-				this->ErrorCode = EspJsonErrorCode::Error_Miss_Comma;
-				return EspJsonObject();
+				char Tag = this->ContainerStack.GetElementAt(this->ContainerStack.GetCount() - 1);
+				this->SkipWhitespace();
+				if (!Closing && this->GetChar() == ',')
+				{
+					this->ParsePos++;
+					if (Tag == '{')
+						this->ParseMemberKey(Builder);
+					break;
+				}
+				if (this->GetChar() != (Tag == '{' ? '}' : ']'))
+				{
+					this->ErrorCode = EspJsonErrorCode::Error_Miss_Comma;
+					break;
+				}
+				this->ParsePos++;
+				this->ContainerStack.DeleteElement(this->ContainerStack.GetCount() - 1);
+				Builder.CloseContainer(Tag == '{' ? '}' : ']');
+				Closing = false;
 			}
+			if (this->ContainerStack.IsEmpty())
+				break;
 		}
 	}
-	void Parse(EspJsonObject& JsonObject)
+	//Every parse entry point starts from the beginning of the copy made by Reset, so the same input can be parsed again
+	void RewindInput() { this->SetInput(this->JsonString.GetAnsiStr(), this->JsonString.GetLength()); }
+	bool ParseRootObject()
 	{
-		if (this->JsonString.GetCharAt(this->ParsePos) != '{')
+		this->RewindInput();
+		this->SkipWhitespace();
+		if (this->GetChar() != '{')
 		{
 			this->ErrorCode = EspJsonErrorCode::Error_Miss_Brace;
-			JsonObject = EspJsonObject();
-			return;
+			return false;
 		}
-		this->ParsePos++;
-		if (this->JsonString.GetCharAt(this->ParsePos) == '}')
+		this->ParseDocument(this->TreeBuilder);
+		return this->ErrorCode == EspJsonErrorCode::Error_NoError;
+	}
+	bool ParseTapeInput(EspJsonTape& Tape)
+	{
+		Tape.Empty();
+		this->TapeBuilder.Tape = &Tape;
+		this->ParseDocument(this->TapeBuilder);
+		if (this->ErrorCode != EspJsonErrorCode::Error_NoError)
 		{
-			JsonObject = EspJsonObject();
-			return;
+			Tape.Empty();
+			return false;
 		}
-		while (true)
+		return true;
+	}
+public:
+	EspJsonParser()
+	{
+		this->SetInput(this->JsonString.GetAnsiStr(), 0);
+		this->ContainerStack.Reserve(this->MaxDepth);
+	}
+	EspJsonParser(const EspString& JsonString)
+	{
+		this->JsonString = JsonString;
+		this->SetInput(this->JsonString.GetAnsiStr(), this->JsonString.GetLength());
+		this->ContainerStack.Reserve(this->MaxDepth);
+	}
+	EspJsonParser(const EspJsonParser&) = delete;
+	const EspJsonParser& operator=(const EspJsonParser&) = delete;
+
+	//Starts over on new input; the input copy, scratch strings, container stack and builder frames keep their buffers
+	void Reset(const char* lpszJson, size_t nLength)
+	{
+		this->JsonString.Assign(lpszJson, (unsigned int)nLength);
+		this->SetInput(this->JsonString.GetAnsiStr(), this->JsonString.GetLength());
+	}
+	void Reset(const char* lpszJson) { this->Reset(lpszJson, EspString::GetLength(lpszJson)); }
+	void Reset(const EspString& JsonString) { this->Reset(JsonString.GetAnsiStr(), JsonString.GetLength()); }
+	EspJsonObject Parse()
+	{
+		EspJsonObject JsonObject;
+		this->Parse(JsonObject);
+		return JsonObject;
+	}
+	void Parse(EspJsonObject& JsonObject)
+	{
+		if (this->ParseRootObject())
+			JsonObject = this->TreeBuilder.Root.GetJsonObject();
+		else
+			JsonObject = EspJsonObject();
+		this->TreeBuilder.Reset();
+	}
+	//Parses any JSON value into a flat read-only tape instead of the EspJsonValue tree; returns false on error
+	bool ParseTape(EspJsonTape& Tape)
+	{
+		this->RewindInput();
+		return this->ParseTapeInput(Tape);
+	}
+	//Parses lpszBuffer without copying it: escapes are decoded over the buffer's own bytes, every string is
+	//terminated with '\0' in place and the tape refers to it, so lpszBuffer must stay alive and unchanged while the tape is used
+	bool ParseTapeInSitu(char* lpszBuffer, size_t nLength, EspJsonTape& Tape)
+	{
+		this->SetInput(lpszBuffer, (unsigned int)nLength);
+		this->InSituBuffer = lpszBuffer;
+		bool Result = this->ParseTapeInput(Tape);
+		if (Result)
+			Tape.Source = lpszBuffer;
+		//Stop referring to the caller's buffer; ParsePos and ErrorCode still describe this parse
+		this->InSituBuffer = NULL;
+		this->Input = this->JsonString.GetAnsiStr();
+		this->InputLength = this->JsonString.GetLength();
+		return Result;
+	}
+	//Parses an object straight into a struct registered with ESP_JSON_BIND; defined in EspJsonBinding.hpp
+	template<class StructType>
+	bool ParseStruct(StructType& Value);
+	//Containers nested deeper than this fail with Error_Depth_Exceeded
+	void SetMaxDepth(unsigned int nMaxDepth)
+	{
+		this->MaxDepth = nMaxDepth;
+		this->ContainerStack.Reserve(nMaxDepth);
+	}
+	unsigned int GetMaxDepth()const { return this->MaxDepth; }
+	const EspJsonErrorCode& GetErrorCode()const { return this->ErrorCode; }
+	const unsigned int& GetParsePos()const { return this->ParsePos; }
+
+};
+
+//Keeps idle parsers so their buffers stay grown between messages; Acquire and Release may be called from any thread
+class EspJsonParserPool
+{
+private:
+	std::mutex Lock;
+	EspArray<EspJsonParser*> IdleParsers;
+	unsigned int MaxIdleCount;
+
+public:
+	EspJsonParserPool(unsigned int nMaxIdleCount = 64) :MaxIdleCount(nMaxIdleCount) { IdleParsers.Reserve(nMaxIdleCount); }
+	EspJsonParserPool(const EspJsonParserPool&) = delete;
+	const EspJsonParserPool& operator=(const EspJsonParserPool&) = delete;
+	~EspJsonParserPool()
+	{
+		for (unsigned int TimeNum = 0; TimeNum < IdleParsers.GetCount(); TimeNum++)
+			delete IdleParsers.GetElementAt(TimeNum);
+	}
+
+	EspJsonParser* Acquire()
+	{
 		{
-			if (this->JsonString.GetCharAt(this->ParsePos) != '"')
+			std::lock_guard<std::mutex> Guard(Lock);
+			if (!IdleParsers.IsEmpty())
 			{
-				this->ErrorCode = EspJsonErrorCode::Error_Miss_Quote;
-				JsonObject.DeleteAll();
-				JsonObject = EspJsonObject();
-				return;
-			}
-			EspJsonMember JsonMember;
-			this->ParseKey(JsonMember.GetKey());
-			if (this->ErrorCode != EspJsonErrorCode::Error_NoError)
-			{
-				JsonObject = EspJsonObject();
-				return;
-			}			//this->ParsePos++;
-			if (this->JsonString.GetCharAt(this->ParsePos) != ':')
-			{
-				this->ErrorCode = EspJsonErrorCode::Error_Miss_Colon;
-				JsonObject.DeleteAll();
-				JsonObject = EspJsonObject();
-				return;
+				EspJsonParser* Parser = IdleParsers.GetElementAt(IdleParsers.GetCount() - 1);
+				IdleParsers.DeleteElement(IdleParsers.GetCount() - 1);
+				return Parser;
 			}
-			this->ParsePos++;
-			this->ParseValue(JsonMember.GetValue());
-			if (this->ErrorCode != EspJsonErrorCode::Error_NoError)
-			{
-				JsonObject = EspJsonObject();
-				return;
-			}
-			JsonObject.AddMember(JsonMember);
-			if (this->JsonString.GetCharAt(this->ParsePos) == ',')
-				this->ParsePos++;
-			else if (this->JsonString.GetCharAt(this->ParsePos) == '}')
-			{
-				this->ErrorCode = EspJsonErrorCode::Error_NoError;
-				return;
-			}
-			else
+		}
+		return new EspJsonParser();
+	}
+	//Parsers beyond the idle limit are freed instead of kept
+	void Release(EspJsonParser* Parser)
+	{
+		{
+			std::lock_guard<std::mutex> Guard(Lock);
+			if (IdleParsers.GetCount() < MaxIdleCount)
 			{
-				this->ErrorCode = EspJsonErrorCode::Error_Miss_Comma;
-				JsonObject.DeleteAll();
-				JsonObject = EspJsonObject();
+				IdleParsers.AddElement(Parser);
 				return;
 			}
 		}
+		delete Parser;
 	}
-	const EspJsonErrorCode& GetErrorCode()const { return this->ErrorCode; }
-	const unsigned int& GetParsePos()const { return this->ParsePos; }
+	unsigned int GetIdleCount()
+	{
+		std::lock_guard<std::mutex> Guard(Lock);
+		return IdleParsers.GetCount();
+	}
+};
+//Acquires a parser for its scope and gives it back on destruction
+class EspPooledJsonParser
+{
+private:
+	EspJsonParserPool& Pool;
+	EspJsonParser* Parser;
 
+public:
+	EspPooledJsonParser(EspJsonParserPool& Pool) :Pool(Pool), Parser(Pool.Acquire()) {}
+	EspPooledJsonParser(EspJsonParserPool& Pool, const char* lpszJson, size_t nLength) :Pool(Pool), Parser(Pool.Acquire()) { Parser->Reset(lpszJson, nLength); }
+	EspPooledJsonParser(const EspPooledJsonParser&) = delete;
+	const EspPooledJsonParser& operator=(const EspPooledJsonParser&) = delete;
+	~EspPooledJsonParser() { Pool.Release(Parser); }
+	EspJsonParser& operator*()const { return *Parser; }
+	EspJsonParser* operator->()const { return Parser; }
 };
 
+void EspJsonValue::CopyValue(const EspJsonValue& NewValue)
+{
+	this->ValueType = NewValue.ValueType;
+	this->NumberValue = NewValue.NumberValue;
+	switch (this->ValueType)
+	{
+	case EspJsonValueType::Value_String:this->AddRef<EspString>(); break;
+	case EspJsonValueType::Value_Object:this->AddRef<EspJsonObject>(); break;
+	case EspJsonValueType::Value_Array:this->AddRef<EspJsonArray>(); break;
+	}
+}
 EspJsonValue::EspJsonValue(EspJsonValueType ValueType, void* ValuePointer)
 {
-	switch (this->ValueType = ValueType)
+	switch (ValueType)
 	{
-	case EspJsonValueType::Value_Boolean:this->ValuePointer = new bool(*(bool*)ValuePointer); break;
-	case EspJsonValueType::Value_Number:this->ValuePointer = new double(*(double*)ValuePointer); break;
-	case EspJsonValueType::Value_String:this->ValuePointer = new EspString(*(EspString*)ValuePointer); break;
-	case EspJsonValueType::Value_Object:this->ValuePointer = new EspJsonObject(*(EspJsonObject*)ValuePointer); break;
-	case EspJsonValueType::Value_Array:this->ValuePointer = new EspJsonArray(*(EspJsonArray*)ValuePointer); break;
+	case EspJsonValueType::Value_Boolean:this->ValueType = ValueType; this->BooleanValue = *(bool*)ValuePointer; break;
+	case EspJsonValueType::Value_Number:this->ValueType = ValueType; this->NumberValue = *(double*)ValuePointer; break;
+	case EspJsonValueType::Value_String:this->SetShared(ValueType, *(EspString*)ValuePointer); break;
+	case EspJsonValueType::Value_Object:this->SetShared(ValueType, *(EspJsonObject*)ValuePointer); break;
+	case EspJsonValueType::Value_Array:this->SetShared(ValueType, *(EspJsonArray*)ValuePointer); break;
+	default:this->ValueType = ValueType; break;
 	}
 }
-EspJsonValue::EspJsonValue(const bool& BooleanValue) { this->ValueType = EspJsonValueType::Value_Boolean; this->ValuePointer = new bool(BooleanValue); }
-EspJsonValue::EspJsonValue(const double& NumberValue) { this->ValueType = EspJsonValueType::Value_Number; this->ValuePointer = new double(NumberValue); }
-EspJsonValue::EspJsonValue(const EspString& StringValue) { this->ValueType = EspJsonValueType::Value_String; this->ValuePointer = new EspString(StringValue); }
-EspJsonValue::EspJsonValue(const EspJsonObject& JsonObject) { this->ValueType = EspJsonValueType::Value_Object; this->ValuePointer = new EspJsonObject(JsonObject); }
-EspJsonValue::EspJsonValue(const EspJsonArray& JsonArray) { this->ValueType = EspJsonValueType::Value_Array; this->ValuePointer = new EspJsonArray(JsonArray); }
+EspJsonValue::EspJsonValue(const bool& BooleanValue) { this->ValueType = EspJsonValueType::Value_Boolean; this->BooleanValue = BooleanValue; }
+EspJsonValue::EspJsonValue(const double& NumberValue) { this->ValueType = EspJsonValueType::Value_Number; this->NumberValue = NumberValue; }
+EspJsonValue::EspJsonValue(const EspString& StringValue) { this->SetShared(EspJsonValueType::Value_String, StringValue); }
+EspJsonValue::EspJsonValue(const EspJsonObject& JsonObject) { this->SetShared(EspJsonValueType::Value_Object, JsonObject); }
+EspJsonValue::EspJsonValue(const EspJsonArray& JsonArray) { this->SetShared(EspJsonValueType::Value_Array, JsonArray); }
 
 EspJsonValue::EspJsonValue(const EspJsonValue& NewValue)
 {
-	switch (this->ValueType = NewValue.ValueType)
-	{
-	case EspJsonValueType::Value_Boolean:this->ValuePointer = new bool(*(bool*)NewValue.ValuePointer); break;
-	case EspJsonValueType::Value_Number:this->ValuePointer = new double(*(double*)NewValue.ValuePointer); break;
-	case EspJsonValueType::Value_String:this->ValuePointer = new EspString(*(EspString*)NewValue.ValuePointer); break;
-	case EspJsonValueType::Value_Object:this->ValuePointer = new EspJsonObject(*(EspJsonObject*)NewValue.ValuePointer); break;
-	case EspJsonValueType::Value_Array:this->ValuePointer = new EspJsonArray(*(EspJsonArray*)NewValue.ValuePointer); break;
-	}
+	this->CopyValue(NewValue);
+}
+EspJsonValue::EspJsonValue(EspJsonValue&& NewValue)
+{
+	this->ValueType = NewValue.ValueType;
+	this->NumberValue = NewValue.NumberValue;
+	NewValue.ValueType = EspJsonValueType::Value_Void;
+	NewValue.ValuePointer = nullptr;
 }
 const bool& EspJsonValue::GetBoolean()const
 {
-	assert(this->ValueType == EspJsonValueType::Value_Boolean && this->ValuePointer != nullptr);
-	return *(bool*)ValuePointer;
+	assert(this->ValueType == EspJsonValueType::Value_Boolean);
+	return this->BooleanValue;
 }
 const double& EspJsonValue::GetNumber()const
 {
-	assert(this->ValueType == EspJsonValueType::Value_Number && this->ValuePointer != nullptr);
-	return *(double*)this->ValuePointer;
+	assert(this->ValueType == EspJsonValueType::Value_Number);
+	return this->NumberValue;
 }
 const EspString& EspJsonValue::GetString()const
 {
 	assert(this->ValueType == EspJsonValueType::Value_String && this->ValuePointer != nullptr);
-	return *(EspString*)this->ValuePointer;
+	return this->GetShared<EspString>();
 }
 EspJsonObject& EspJsonValue::GetJsonObject()
 {
 	assert(this->ValueType == EspJsonValueType::Value_Object && this->ValuePointer != nullptr);
-	return *(EspJsonObject*)this->ValuePointer;
+	return this->Detach<EspJsonObject>();
 }
 EspJsonArray& EspJsonValue::GetJsonArray()
 {
 	assert(this->ValueType == EspJsonValueType::Value_Array && this->ValuePointer != nullptr);
-	return *(EspJsonArray*)this->ValuePointer;
+	return this->Detach<EspJsonArray>();
+}
+const EspJsonObject& EspJsonValue::GetJsonObject()const
+{
+	assert(this->ValueType == EspJsonValueType::Value_Object && this->ValuePointer != nullptr);
+	return this->GetShared<EspJsonObject>();
+}
+const EspJsonArray& EspJsonValue::GetJsonArray()const
+{
+	assert(this->ValueType == EspJsonValueType::Value_Array && this->ValuePointer != nullptr);
+	return this->GetShared<EspJsonArray>();
+}
+unsigned int EspJsonValue::GetShareCount()const
+{
+	switch (this->ValueType)
+	{
+	case EspJsonValueType::Value_String:return ((EspJsonShared<EspString>*)this->ValuePointer)->RefCount.load();
+	case EspJsonValueType::Value_Object:return ((EspJsonShared<EspJsonObject>*)this->ValuePointer)->RefCount.load();
+	case EspJsonValueType::Value_Array:return ((EspJsonShared<EspJsonArray>*)this->ValuePointer)->RefCount.load();
+	default:return 0;
+	}
 }
 void EspJsonValue::SetBoolean(const bool& NewValue)
 {
 	this->PreFreeValue();
 	this->ValueType = EspJsonValueType::Value_Boolean;
-	this->ValuePointer = new bool(NewValue);
+	this->BooleanValue = NewValue;
 }
 void EspJsonValue::SetNull()
 {
 	this->PreFreeValue();
 	this->ValueType = EspJsonValueType::Value_Null;
+	this->ValuePointer = nullptr;
 }
 void EspJsonValue::SetNumber(const double& NewValue)
 {
 	this->PreFreeValue();
 	this->ValueType = EspJsonValueType::Value_Number;
-	this->ValuePointer = new double(NewValue);
+	this->NumberValue = NewValue;
 }
 void EspJsonValue::SetString(const EspString& NewValue)
 {
-	this->PreFreeValue();
-	this->ValueType = EspJsonValueType::Value_String;
-	this->ValuePointer = new EspString(NewValue);
-}
-void EspJsonValue::SetJsonObject(const EspJsonObject& JsonObject)
-{
-	this->PreFreeValue();
-	this->ValueType = EspJsonValueType::Value_Object;
-	this->ValuePointer = new EspJsonObject(JsonObject);
+	if (this->ValueType == EspJsonValueType::Value_String && ((EspJsonShared<EspString>*)this->ValuePointer)->RefCount.load(std::memory_order_acquire) == 1)
+		this->GetShared<EspString>() = NewValue;
+	else
+		this->SetShared(EspJsonValueType::Value_String, NewValue);
 }
-void EspJsonValue::SetJsonArray(const EspJsonArray& JsonArray)
+void EspJsonValue::SetJsonObject(const EspJsonObject& JsonObject) { this->SetShared(EspJsonValueType::Value_Object, JsonObject); }
+void EspJsonValue::SetJsonArray(const EspJsonArray& JsonArray) { this->SetShared(EspJsonValueType::Value_Array, JsonArray); }
+void EspJsonValue::PreFreeValue()const
 {
-	this->PreFreeValue();
-	this->ValueType = EspJsonValueType::Value_Array;
-	this->ValuePointer = new EspJsonArray(JsonArray);
+	switch (this->ValueType)
+	{
+	case EspJsonValueType::Value_String:this->Release<EspString>(); break;
+	case EspJsonValueType::Value_Object:case EspJsonValueType::Value_Array:
+		if (this->GetShareCount() == 1)
+			this->ReleaseTree();
+		else if (this->ValueType == EspJsonValueType::Value_Object)
+			this->Release<EspJsonObject>();
+		else
+			this->Release<EspJsonArray>();
+		break;
+	}
 }
-void EspJsonValue::PreFreeValue()const
+//Frees the last reference to a container without recursing: nested containers owned only by it are moved
+//to a pending list first, so tearing down a deeply nested document needs no deep C++ stack either
+void EspJsonValue::ReleaseTree()const
 {
-	if (this->ValuePointer != nullptr)
-		switch (this->ValueType)
+	EspArray<EspJsonValue> Pending;
+	EspJsonValue Current;
+	Current.ValueType = this->ValueType;
+	Current.ValuePointer = this->ValuePointer;
+	while (true)
+	{
+		auto TakeChild = [&Pending](EspJsonValue& Child)
 		{
-		case EspJsonValueType::Value_Boolean:delete (bool*)ValuePointer; break;
-		case EspJsonValueType::Value_Number:delete (double*)ValuePointer; break;
-		case EspJsonValueType::Value_String:delete (EspString*)ValuePointer; break;
-		case EspJsonValueType::Value_Object:delete (EspJsonObject*)ValuePointer; break;
-		case EspJsonValueType::Value_Array:delete (EspJsonArray*)ValuePointer; break;
+			if ((Child.IsObject() || Child.IsArray()) && Child.GetShareCount() == 1)
+				Pending.AddElement(std::move(Child));
+		};
+		if (Current.IsObject())
+		{
+			EspJsonObject& JsonObject = Current.GetShared<EspJsonObject>();
+			for (unsigned int TimeNum = 0; TimeNum < JsonObject.GetCount(); TimeNum++)
+				TakeChild(JsonObject.GetMember(TimeNum).GetValue());
+			Current.Release<EspJsonObject>();
 		}
+		else
+		{
+			EspJsonArray& JsonArray = Current.GetShared<EspJsonArray>();
+			for (unsigned int TimeNum = 0; TimeNum < JsonArray.GetCount(); TimeNum++)
+				TakeChild(JsonArray.GetValue(TimeNum));
+			Current.Release<EspJsonArray>();
+		}
+		Current.ValueType = EspJsonValueType::Value_Void;
+		if (Pending.IsEmpty())
+			return;
+		Current = std::move(Pending.GetElementAt(Pending.GetCount() - 1));
+		Pending.DeleteElement(Pending.GetCount() - 1);
+	}
 }
 const EspJsonValue& EspJsonValue::operator=(const EspJsonValue& NewValue)
 {
-	this->PreFreeValue();
-	switch (this->ValueType = NewValue.ValueType)
+	if (&NewValue != this)
 	{
-	case EspJsonValueType::Value_Boolean:this->ValuePointer = new bool(*(bool*)NewValue.ValuePointer); break;
-	case EspJsonValueType::Value_Number:this->ValuePointer = new double(*(double*)NewValue.ValuePointer); break;
-	case EspJsonValueType::Value_String:this->ValuePointer = new EspString(*(EspString*)NewValue.ValuePointer); break;
-	case EspJsonValueType::Value_Object:this->ValuePointer = new EspJsonObject(*(EspJsonObject*)NewValue.ValuePointer); break;
-	case EspJsonValueType::Value_Array:this->ValuePointer = new EspJsonArray(*(EspJsonArray*)NewValue.ValuePointer); break;
+		//NewValue may live inside the payload this value is about to release
+		EspJsonValue OldValue(std::move(*this));
+		this->CopyValue(NewValue);
+	}
+	return *this;
+}
+const EspJsonValue& EspJsonValue::operator=(EspJsonValue&& NewValue)
+{
+	if (&NewValue != this)
+	{
+		EspJsonValue OldValue(std::move(*this));
+		this->ValueType = NewValue.ValueType;
+		this->NumberValue = NewValue.NumberValue;
+		NewValue.ValueType = EspJsonValueType::Value_Void;
+		NewValue.ValuePointer = nullptr;
 	}
 	return *this;
 }
 EspJsonValue& EspJsonValue::operator[](const EspString& Key) { return this->GetJsonObject().GetValue(Key); }
 EspJsonValue& EspJsonValue::operator[](const unsigned int Index) { return this->GetJsonArray().GetValue(Index); }
+const EspJsonValue& EspJsonValue::operator[](const EspString& Key)const { return this->GetJsonObject().GetValue(Key); }
+const EspJsonValue& EspJsonValue::operator[](const unsigned int Index)const { return this->GetJsonArray().GetValue(Index); }
 
-EspString EspJsonObject::Synthesize()const
+//Appends the JSON text of a value to an output, so nested containers are written into one buffer instead of being
+//synthesized separately and copied into their parents. Synthesize() and the parallel writer both use it.
+//OutputType is EspString or anything with the same Append overloads for a char, a C string, a pointer and length and an EspString.
+class EspJsonWriter
 {
-	if (this->JsonObject.IsEmptyOrNull())return EspString("{}");
-	EspString Result("{");
-	for (unsigned int TimeNum = 0; TimeNum < this->JsonObject.GetCount(); TimeNum++)
+public:
+	template<class OutputType>
+	static void WriteString(const EspString& StringValue, OutputType& Output)
 	{
-		//Key
-		Result.Append('"').Append(this->JsonObject.GetElementAt(TimeNum).GetKey()).Append('"').Append(':');
-		//Value
-		switch (this->JsonObject.GetElementAt(TimeNum).GetValue().GetValueType())
+		const char* Data = StringValue.GetAnsiStr();
+		unsigned int Length = StringValue.GetLength();
+		Output.Append('"');
+		unsigned int RunStart = 0;
+		for (unsigned int TimeNum = 0; TimeNum < Length; TimeNum++)
 		{
-		case EspJsonValueType::Value_Boolean:this->JsonObject.GetElementAt(TimeNum).GetValue().GetBoolean() ? Result.Append("true") : Result.Append("false"); break;
-		case EspJsonValueType::Value_Null:Result.Append("null"); break;
-		case EspJsonValueType::Value_Number:Result.Append(EspString::ToString(this->JsonObject.GetElementAt(TimeNum).GetValue().GetNumber(), 20)); break;
-		case EspJsonValueType::Value_String:Result.Append('"').Append(this->JsonObject.GetElementAt(TimeNum).GetValue().GetString()).Append('"'); break;
-		case EspJsonValueType::Value_Object: Result.Append(this->JsonObject.GetElementAt(TimeNum).GetValue().GetJsonObject().Synthesize()); break;
-		case EspJsonValueType::Value_Array:Result.Append(this->JsonObject.GetElementAt(TimeNum).GetValue().GetJsonArray().Synthesize()); break;
+			unsigned char Char = (unsigned char)Data[TimeNum];
+			if (Char >= 0x20 && Char != '"' && Char != '\\')
+				continue;
+			if (TimeNum > RunStart)
+				Output.Append(Data + RunStart, TimeNum - RunStart);
+			RunStart = TimeNum + 1;
+			switch (Char)
+			{
+			case '"':Output.Append("\\\""); break;
+			case '\\':Output.Append("\\\\"); break;
+			case '\b':Output.Append("\\b"); break;
+			case '\f':Output.Append("\\f"); break;
+			case '\n':Output.Append("\\n"); break;
+			case '\r':Output.Append("\\r"); break;
+			case '\t':Output.Append("\\t"); break;
+			default:
+			{
+				const char* Hex = "0123456789abcdef";
+				char Escape[6] = { '\\', 'u', '0', '0', Hex[Char >> 4], Hex[Char & 0x0F] };
+				Output.Append(Escape, 6);
+				break;
+			}
+			}
 		}
-		if (TimeNum != this->JsonObject.GetCount() - 1)
-			Result.Append(',');
+		if (Length > RunStart)
+			Output.Append(Data + RunStart, Length - RunStart);
+		Output.Append('"');
 	}
-	return Result.Append('}');
-}
-EspString EspJsonArray::Synthesize()const
-{
-	if (this->JsonArray.IsEmptyOrNull())return EspString("{}");
-	EspString Result("[");
-	for (unsigned int TimeNum = 0; TimeNum < this->JsonArray.GetCount(); TimeNum++)
+	template<class OutputType>
+	static void WriteValue(const EspJsonValue& Value, OutputType& Output)
+	{
+		switch (Value.GetValueType())
+		{
+		case EspJsonValueType::Value_Boolean:Output.Append(Value.GetBoolean() ? "true" : "false"); break;
+		case EspJsonValueType::Value_Null:Output.Append("null"); break;
+		case EspJsonValueType::Value_Number:Output.Append(EspString::ToString(Value.GetNumber(), 20)); break;
+		case EspJsonValueType::Value_String:EspJsonWriter::WriteString(Value.GetString(), Output); break;
+		case EspJsonValueType::Value_Object:EspJsonWriter::WriteObject(Value.GetJsonObject(), Output); break;
+		case EspJsonValueType::Value_Array:EspJsonWriter::WriteArray(Value.GetJsonArray(), Output); break;
+		}
+	}
+	//Members [First, Last) with a ',' before each one except member 0, so consecutive ranges concatenate into the full list
+	template<class OutputType>
+	static void WriteMembers(const EspJsonObject& JsonObject, unsigned int First, unsigned int Last, OutputType& Output)
+	{
+		for (unsigned int TimeNum = First; TimeNum < Last; TimeNum++)
+		{
+			if (TimeNum != 0)
+				Output.Append(',');
+			const EspJsonMember& Member = JsonObject.GetMember(TimeNum);
+			EspJsonWriter::WriteString(Member.GetKey(), Output);
+			Output.Append(':');
+			EspJsonWriter::WriteValue(Member.GetValue(), Output);
+		}
+	}
+	template<class OutputType>
+	static void WriteElements(const EspJsonArray& JsonArray, unsigned int First, unsigned int Last, OutputType& Output)
 	{
-		//Value
-		switch (this->JsonArray.GetElementAt(TimeNum).GetValueType())
+		for (unsigned int TimeNum = First; TimeNum < Last; TimeNum++)
 		{
-		case EspJsonValueType::Value_Boolean:this->JsonArray.GetElementAt(TimeNum).GetBoolean() ? Result.Append("true") : Result.Append("false"); break;
-		case EspJsonValueType::Value_Null:Result.Append("null"); break;
-		case EspJsonValueType::Value_Number:Result.Append(EspString::ToString(this->JsonArray.GetElementAt(TimeNum).GetNumber(), 20)); break;
-		case EspJsonValueType::Value_String:Result.Append('"').Append(this->JsonArray.GetElementAt(TimeNum).GetString()).Append('"'); break;
-		case EspJsonValueType::Value_Object: Result.Append(this->JsonArray.GetElementAt(TimeNum).GetJsonObject().Synthesize()); break;
-		case EspJsonValueType::Value_Array:Result.Append(this->JsonArray.GetElementAt(TimeNum).GetJsonArray().Synthesize()); break;
+			if (TimeNum != 0)
+				Output.Append(',');
+			EspJsonWriter::WriteValue(JsonArray.GetValue(TimeNum), Output);
 		}
-		if (TimeNum != this->JsonArray.GetCount() - 1)
-			Result.Append(',');
 	}
-	return Result.Append(']');
+	template<class OutputType>
+	static void WriteObject(const EspJsonObject& JsonObject, OutputType& Output)
+	{
+		Output.Append('{');
+		EspJsonWriter::WriteMembers(JsonObject, 0, JsonObject.GetCount(), Output);
+		Output.Append('}');
+	}
+	template<class OutputType>
+	static void WriteArray(const EspJsonArray& JsonArray, OutputType& Output)
+	{
+		Output.Append('[');
+		EspJsonWriter::WriteElements(JsonArray, 0, JsonArray.GetCount(), Output);
+		Output.Append(']');
+	}
+};
+
+EspString EspJsonObject::Synthesize()const
+{
+	EspString Result;
+	EspJsonWriter::WriteObject(*this, Result);
+	return Result;
+}
+EspString EspJsonArray::Synthesize()const
+{
+	EspString Result;
+	EspJsonWriter::WriteArray(*this, Result);
+	return Result;
 }
@@ -0,0 +1,299 @@
+#pragma once
+#include<assert.h>
+#include<memory>
+#include<type_traits>
+#if defined(_WIN32)
+#include<Windows.h>
+#else
+#include<fcntl.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<unistd.h>
+#endif
+#ifndef __ESPMAPPEDARRAY__
+#define __ESPMAPPEDARRAY__
+#endif
+
+//File layout: a 64-byte EspMappedHeader followed by the elements. The file is grown geometrically and remapped,
+//so element pointers are invalidated by growth just like EspArray. Count is stored in the header, so Flush() plus
+//reopening the file restores the array without any parsing.
+struct EspMappedHeader
+{
+	unsigned int Magic;
+	unsigned int ElementSize;
+	unsigned long long Count;
+	unsigned char Reserved[48];
+};
+
+template<class EspType>
+class EspMappedArray
+{
+	static_assert(std::is_trivially_copyable<EspType>::value, "EspMappedArray stores raw bytes and needs a trivially copyable type");
+private:
+	static const unsigned int MappedMagic = 0x41505345;	//"ESPA"
+	static const unsigned int HeaderSize = sizeof(EspMappedHeader);
+
+	EspMappedHeader* Header = nullptr;
+	EspType* ArrayData = nullptr;
+	unsigned int AllocSize = 0;
+#if defined(_WIN32)
+	HANDLE FileHandle = INVALID_HANDLE_VALUE;
+	HANDLE MappingHandle = NULL;
+#else
+	int FileHandle = -1;
+#endif
+
+	unsigned long long GetFileSize(unsigned int nAllocSize)const { return HeaderSize + (unsigned long long)nAllocSize * sizeof(EspType); }
+	void Unmap()
+	{
+		if (Header == NULL)
+			return;
+#if defined(_WIN32)
+		::UnmapViewOfFile(Header);
+		::CloseHandle(MappingHandle);
+		MappingHandle = NULL;
+#else
+		::munmap(Header, GetFileSize(AllocSize));
+#endif
+		Header = NULL;
+		ArrayData = NULL;
+	}
+	//Resizes the file to hold nAllocSize elements and maps all of it
+	bool Map(unsigned int nAllocSize)
+	{
+		unsigned long long FileSize = GetFileSize(nAllocSize);
+#if defined(_WIN32)
+		MappingHandle = ::CreateFileMappingA(FileHandle, NULL, PAGE_READWRITE, (DWORD)(FileSize >> 32), (DWORD)FileSize, NULL);
+		if (MappingHandle == NULL)
+			return false;
+		void* View = ::MapViewOfFile(MappingHandle, FILE_MAP_ALL_ACCESS, 0, 0, (SIZE_T)FileSize);
+		if (View == NULL)
+		{
+			::CloseHandle(MappingHandle);
+			MappingHandle = NULL;
+			return false;
+		}
+#else
+		if (::ftruncate(FileHandle, (off_t)FileSize) != 0)
+			return false;
+		void* View = ::mmap(NULL, FileSize, PROT_READ | PROT_WRITE, MAP_SHARED, FileHandle, 0);
+		if (View == MAP_FAILED)
+			return false;
+#endif
+		Header = (EspMappedHeader*)View;
+		ArrayData = (EspType*)((unsigned char*)View + HeaderSize);
+		AllocSize = nAllocSize;
+		return true;
+	}
+	//The new view is mapped before the old one is released, so a failed grow leaves the array as it was
+	void Remap(unsigned int NewAllocSize)
+	{
+#if defined(_WIN32)
+		HANDLE OldMapping = MappingHandle;
+		void* OldView = Header;
+		if (!Map(NewAllocSize))
+		{
+			MappingHandle = OldMapping;
+			throw("Allocate Buffer Unsuccessfully!");
+		}
+		::UnmapViewOfFile(OldView);
+		::CloseHandle(OldMapping);
+#else
+		unsigned long long OldFileSize = GetFileSize(AllocSize);
+		unsigned long long FileSize = GetFileSize(NewAllocSize);
+		if (FileSize > OldFileSize && ::ftruncate(FileHandle, (off_t)FileSize) != 0)
+			throw("Allocate Buffer Unsuccessfully!");
+#if defined(__linux__)
+		void* View = ::mremap(Header, OldFileSize, FileSize, MREMAP_MAYMOVE);
+#else
+		void* View = ::mmap(NULL, FileSize, PROT_READ | PROT_WRITE, MAP_SHARED, FileHandle, 0);
+#endif
+		if (View == MAP_FAILED)
+			throw("Allocate Buffer Unsuccessfully!");
+#if !defined(__linux__)
+		::munmap(Header, OldFileSize);
+#endif
+		Header = (EspMappedHeader*)View;
+		ArrayData = (EspType*)((unsigned char*)View + HeaderSize);
+		AllocSize = NewAllocSize;
+		//A file that fails to shrink only keeps spare capacity, which Open accepts
+		if (FileSize < OldFileSize && ::ftruncate(FileHandle, (off_t)FileSize) != 0)
+			return;
+#endif
+	}
+	void GrowFor(unsigned int NewArraySize)
+	{
+		if (NewArraySize > AllocSize)
+			Remap(NewArraySize > AllocSize * 2 ? NewArraySize : AllocSize * 2);
+	}
+
+public:
+	EspMappedArray() {}
+	EspMappedArray(const char* lpszFileName) { Open(lpszFileName); }
+	EspMappedArray(const EspMappedArray&) = delete;
+	const EspMappedArray& operator=(const EspMappedArray&) = delete;
+	~EspMappedArray() { Close(); }
+
+	//Opens or creates the file; an existing file must have been written by an EspMappedArray of the same element size
+	bool Open(const char* lpszFileName)
+	{
+		Close();
+		unsigned long long FileSize;
+#if defined(_WIN32)
+		FileHandle = ::CreateFileA(lpszFileName, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (FileHandle == INVALID_HANDLE_VALUE)
+			return false;
+		LARGE_INTEGER Size;
+		if (!::GetFileSizeEx(FileHandle, &Size))
+		{
+			Close();
+			return false;
+		}
+		FileSize = (unsigned long long)Size.QuadPart;
+#else
+		FileHandle = ::open(lpszFileName, O_RDWR | O_CREAT, 0644);
+		if (FileHandle < 0)
+			return false;
+		struct stat Status;
+		if (::fstat(FileHandle, &Status) != 0)
+		{
+			Close();
+			return false;
+		}
+		FileSize = (unsigned long long)Status.st_size;
+#endif
+		if (FileSize == 0)
+		{
+			if (!Map(16))
+			{
+				Close();
+				return false;
+			}
+			::memset(Header, 0, HeaderSize);
+			Header->Magic = MappedMagic;
+			Header->ElementSize = sizeof(EspType);
+			return true;
+		}
+		if (FileSize < HeaderSize || (FileSize - HeaderSize) % sizeof(EspType) != 0 || !Map((unsigned int)((FileSize - HeaderSize) / sizeof(EspType))))
+		{
+			Close();
+			return false;
+		}
+		if (Header->Magic != MappedMagic || Header->ElementSize != sizeof(EspType) || Header->Count > AllocSize)
+		{
+			Close();
+			return false;
+		}
+		return true;
+	}
+	//Unmaps and closes the file; the file keeps its spare capacity, ShrinkToFit() first to trim it
+	void Close()
+	{
+		Unmap();
+#if defined(_WIN32)
+		if (FileHandle != INVALID_HANDLE_VALUE)
+			::CloseHandle(FileHandle);
+		FileHandle = INVALID_HANDLE_VALUE;
+#else
+		if (FileHandle >= 0)
+			::close(FileHandle);
+		FileHandle = -1;
+#endif
+		AllocSize = 0;
+	}
+	bool IsOpen()const { return Header != NULL; }
+	//Writes dirty pages back to the file; Async only schedules the write
+	bool Flush(bool Async = false)
+	{
+		if (Header == NULL)
+			return false;
+#if defined(_WIN32)
+		if (!::FlushViewOfFile(Header, 0))
+			return false;
+		return Async || ::FlushFileBuffers(FileHandle);
+#else
+		return ::msync(Header, GetFileSize(AllocSize), Async ? MS_ASYNC : MS_SYNC) == 0;
+#endif
+	}
+
+	void Reserve(unsigned int NewAllocSize)
+	{
+		assert(Header != NULL);
+		if (NewAllocSize > AllocSize)
+			Remap(NewAllocSize);
+	}
+	void ShrinkToFit()
+	{
+		assert(Header != NULL);
+		unsigned int Count = GetCount();
+		if (Count < AllocSize)
+		{
+#if defined(_WIN32)
+			//A mapping cannot shrink its file, so trim it while nothing is mapped
+			Unmap();
+			LARGE_INTEGER Size;
+			Size.QuadPart = (LONGLONG)GetFileSize(Count > 0 ? Count : 1);
+			::SetFilePointerEx(FileHandle, Size, NULL, FILE_BEGIN);
+			::SetEndOfFile(FileHandle);
+			if (!Map(Count > 0 ? Count : 1))
+				throw("Allocate Buffer Unsuccessfully!");
+#else
+			Remap(Count > 0 ? Count : 1);
+#endif
+		}
+	}
+	void AddElement(const EspType& NewElement)
+	{
+		assert(Header != NULL);
+		unsigned int Count = GetCount();
+		if (Count == AllocSize)
+		{
+			//NewElement may point into the mapping that is about to move
+			EspType Element(NewElement);
+			GrowFor(Count + 1);
+			ArrayData[Count] = Element;
+		}
+		else
+			ArrayData[Count] = NewElement;
+		Header->Count = Count + 1;
+	}
+	void AddElements(const EspType* NewElements, unsigned int nCount)
+	{
+		assert(Header != NULL && (NewElements < ArrayData || NewElements >= ArrayData + AllocSize));
+		unsigned int Count = GetCount();
+		GrowFor(Count + nCount);
+		if (nCount > 0)
+			::memcpy((void*)(ArrayData + Count), (const void*)NewElements, nCount * sizeof(EspType));
+		Header->Count = Count + nCount;
+	}
+	void DeleteLast(unsigned int nCount = 1)
+	{
+		assert(nCount <= GetCount());
+		Header->Count -= nCount;
+	}
+	EspType& GetElementAt(unsigned int Index)const
+	{
+		assert(Index < GetCount());
+		return ArrayData[Index];
+	}
+	EspType& operator[](unsigned int Index)const { return GetElementAt(Index); }
+	void SetElementAt(unsigned int Index, const EspType& NewElement)
+	{
+		assert(Index < GetCount());
+		ArrayData[Index] = NewElement;
+	}
+	unsigned int GetCount()const { return Header != NULL ? (unsigned int)Header->Count : 0; }
+	unsigned int GetBufSize()const { return AllocSize; }
+	const EspType* GetBuffer()const { return ArrayData; }
+	EspType* GetBuffer() { return ArrayData; }
+	bool IsEmpty()const { return GetCount() == 0; }
+	EspType* begin() { return ArrayData; }
+	EspType* end() { return ArrayData + GetCount(); }
+	const EspType* begin()const { return ArrayData; }
+	const EspType* end()const { return ArrayData + GetCount(); }
+	void Empty()
+	{
+		if (Header != NULL)
+			Header->Count = 0;
+	}
+};
@@ -0,0 +1,302 @@
+#pragma once
+#include<assert.h>
+#include<atomic>
+#include<condition_variable>
+#include<deque>
+#include<exception>
+#include<functional>
+#include<mutex>
+#include<thread>
+#include"EspArray.hpp"
+#ifndef __ESPPARALLEL__
+#define __ESPPARALLEL__
+#endif
+
+//Every worker owns a deque: it pushes and pops its own tasks at the back and steals from the front of the others,
+//so recursively split ranges are run depth-first locally while idle threads take the largest pending halves.
+class EspThreadPool
+{
+private:
+	struct EspWorkQueue
+	{
+		std::mutex Lock;
+		std::deque<std::function<void()>> Tasks;
+	};
+
+	EspWorkQueue* Queues = nullptr;
+	std::thread* Threads = nullptr;
+	unsigned int ThreadCount = 0;
+	std::atomic<unsigned int> QueuedCount{ 0 };
+	std::atomic<unsigned int> NextQueue{ 0 };
+	std::atomic<bool> Stopping{ false };
+	std::mutex SleepLock;
+	std::condition_variable WakeUp;
+
+	static EspThreadPool*& CurrentPool()
+	{
+		static thread_local EspThreadPool* Pool = nullptr;
+		return Pool;
+	}
+	static unsigned int& CurrentWorker()
+	{
+		static thread_local unsigned int Worker = -1;
+		return Worker;
+	}
+	unsigned int GetHomeQueue()
+	{
+		if (EspThreadPool::CurrentPool() == this)
+			return EspThreadPool::CurrentWorker();
+		return NextQueue.fetch_add(1, std::memory_order_relaxed) % ThreadCount;
+	}
+	void WorkerLoop(unsigned int Worker)
+	{
+		EspThreadPool::CurrentPool() = this;
+		EspThreadPool::CurrentWorker() = Worker;
+		while (true)
+		{
+			if (RunOne())
+				continue;
+			std::unique_lock<std::mutex> Guard(SleepLock);
+			WakeUp.wait(Guard, [this] { return QueuedCount.load() > 0 || Stopping.load(); });
+			if (Stopping.load() && QueuedCount.load() == 0)
+				return;
+		}
+	}
+
+public:
+	//ThreadCount = 0 uses one worker per hardware thread
+	EspThreadPool(unsigned int ThreadCount = 0)
+	{
+		if (ThreadCount == 0)
+			ThreadCount = std::thread::hardware_concurrency();
+		this->ThreadCount = ThreadCount > 0 ? ThreadCount : 1;
+		Queues = new EspWorkQueue[this->ThreadCount];
+		Threads = new std::thread[this->ThreadCount];
+		for (unsigned int TimeNum = 0; TimeNum < this->ThreadCount; TimeNum++)
+			Threads[TimeNum] = std::thread(&EspThreadPool::WorkerLoop, this, TimeNum);
+	}
+	EspThreadPool(const EspThreadPool&) = delete;
+	const EspThreadPool& operator=(const EspThreadPool&) = delete;
+	~EspThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> Guard(SleepLock);
+			Stopping.store(true);
+		}
+		WakeUp.notify_all();
+		for (unsigned int TimeNum = 0; TimeNum < ThreadCount; TimeNum++)
+			Threads[TimeNum].join();
+		delete[] Threads;
+		delete[] Queues;
+	}
+	static EspThreadPool& GetDefault()
+	{
+		static EspThreadPool Pool;
+		return Pool;
+	}
+	unsigned int GetThreadCount()const { return ThreadCount; }
+
+	void Submit(std::function<void()> Task)
+	{
+		EspWorkQueue& Queue = Queues[GetHomeQueue()];
+		{
+			std::lock_guard<std::mutex> Guard(Queue.Lock);
+			Queue.Tasks.push_back(std::move(Task));
+		}
+		QueuedCount.fetch_add(1);
+		{
+			std::lock_guard<std::mutex> Guard(SleepLock);
+		}
+		WakeUp.notify_one();
+	}
+	//Runs one queued task on the calling thread; returns false when every queue is empty
+	bool RunOne()
+	{
+		std::function<void()> Task;
+		unsigned int Home = GetHomeQueue();
+		for (unsigned int TimeNum = 0; TimeNum < ThreadCount && !Task; TimeNum++)
+		{
+			EspWorkQueue& Queue = Queues[(Home + TimeNum) % ThreadCount];
+			std::lock_guard<std::mutex> Guard(Queue.Lock);
+			if (Queue.Tasks.empty())
+				continue;
+			if (TimeNum == 0 && EspThreadPool::CurrentPool() == this)
+			{
+				Task = std::move(Queue.Tasks.back());
+				Queue.Tasks.pop_back();
+			}
+			else
+			{
+				Task = std::move(Queue.Tasks.front());
+				Queue.Tasks.pop_front();
+			}
+		}
+		if (!Task)
+			return false;
+		QueuedCount.fetch_sub(1);
+		Task();
+		return true;
+	}
+};
+
+//Counts outstanding tasks; Wait() helps run queued work instead of blocking and rethrows the first task exception
+class EspTaskGroup
+{
+private:
+	EspThreadPool& Pool;
+	std::atomic<unsigned int> Pending{ 0 };
+	std::mutex ErrorLock;
+	std::exception_ptr Error;
+
+public:
+	EspTaskGroup(EspThreadPool& Pool = EspThreadPool::GetDefault()) :Pool(Pool) {}
+	EspTaskGroup(const EspTaskGroup&) = delete;
+	~EspTaskGroup()
+	{
+		while (Pending.load() > 0)
+			if (!Pool.RunOne())
+				std::this_thread::yield();
+	}
+	EspThreadPool& GetPool() { return Pool; }
+
+	template<class FuncType>
+	void Run(FuncType Func)
+	{
+		Pending.fetch_add(1);
+		Pool.Submit([this, Func]()
+			{
+				try
+				{
+					Func();
+				}
+				catch (...)
+				{
+					std::lock_guard<std::mutex> Guard(ErrorLock);
+					if (!Error)
+						Error = std::current_exception();
+				}
+				Pending.fetch_sub(1, std::memory_order_release);
+			});
+	}
+	void Wait()
+	{
+		while (Pending.load(std::memory_order_acquire) > 0)
+			if (!Pool.RunOne())
+				std::this_thread::yield();
+		if (Error)
+		{
+			std::exception_ptr Thrown = Error;
+			Error = nullptr;
+			std::rethrow_exception(Thrown);
+		}
+	}
+};
+
+//Grain = 0 picks about eight pieces per worker
+inline unsigned int EspGetChunkCount(unsigned int Count, unsigned int& Grain, EspThreadPool& Pool)
+{
+	if (Grain == 0)
+	{
+		Grain = Count / (Pool.GetThreadCount() * 8);
+		Grain = Grain > 0 ? Grain : 1;
+	}
+	return (Count + Grain - 1) / Grain;
+}
+
+//Calls Func(Begin, End) over [0, Count) in pieces of at most Grain indexes; piece boundaries are multiples of Grain
+template<class FuncType>
+void EspParallelFor(unsigned int Count, unsigned int Grain, FuncType Func, EspThreadPool& Pool = EspThreadPool::GetDefault())
+{
+	if (Count == 0)
+		return;
+	EspGetChunkCount(Count, Grain, Pool);
+	if (Count <= Grain)
+	{
+		Func(0u, Count);
+		return;
+	}
+	//Split outlives Group: if Func throws here, ~EspTaskGroup still runs queued halves that call Split
+	std::function<void(unsigned int, unsigned int)> Split;
+	EspTaskGroup Group(Pool);
+	Split = [&](unsigned int Begin, unsigned int End)
+	{
+		while (End - Begin > Grain)
+		{
+			unsigned int Middle = Begin + ((End - Begin) / Grain + 1) / 2 * Grain;
+			Group.Run([&Split, Middle, End]() { Split(Middle, End); });
+			End = Middle;
+		}
+		Func(Begin, End);
+	};
+	Split(0, Count);
+	Group.Wait();
+}
+template<class EspType, unsigned int InlineCount, class FuncType>
+void ParallelForEach(EspArray<EspType, InlineCount>& Array, FuncType Func, unsigned int Grain = 0, EspThreadPool& Pool = EspThreadPool::GetDefault())
+{
+	EspType* Data = Array.GetBuffer();
+	EspParallelFor(Array.GetCount(), Grain, [Data, &Func](unsigned int Begin, unsigned int End)
+		{
+			for (unsigned int TimeNum = Begin; TimeNum < End; TimeNum++)
+				Func(Data[TimeNum]);
+		}, Pool);
+}
+//Result[i] = Func(Source[i]); Result is resized to the source count
+template<class EspType, unsigned int InlineCount, class ResultType, unsigned int ResultInlineCount, class FuncType>
+void ParallelTransform(const EspArray<EspType, InlineCount>& Source, EspArray<ResultType, ResultInlineCount>& Result, FuncType Func, unsigned int Grain = 0, EspThreadPool& Pool = EspThreadPool::GetDefault())
+{
+	Result.Resize(Source.GetCount());
+	const EspType* SourceData = Source.GetBuffer();
+	ResultType* ResultData = Result.GetBuffer();
+	EspParallelFor(Source.GetCount(), Grain, [SourceData, ResultData, &Func](unsigned int Begin, unsigned int End)
+		{
+			for (unsigned int TimeNum = Begin; TimeNum < End; TimeNum++)
+				ResultData[TimeNum] = Func(SourceData[TimeNum]);
+		}, Pool);
+}
+//Folds each chunk with Reduce(Accumulator, Element) starting from Identity, then merges the chunk results in index order with Combine
+template<class EspType, unsigned int InlineCount, class ResultType, class ReduceType, class CombineType>
+ResultType ParallelReduce(const EspArray<EspType, InlineCount>& Array, const ResultType& Identity, ReduceType Reduce, CombineType Combine, unsigned int Grain = 0, EspThreadPool& Pool = EspThreadPool::GetDefault())
+{
+	unsigned int ChunkCount = EspGetChunkCount(Array.GetCount(), Grain, Pool);
+	EspArray<ResultType> Partials;
+	for (unsigned int TimeNum = 0; TimeNum < ChunkCount; TimeNum++)
+		Partials.AddElement(Identity);
+	const EspType* Data = Array.GetBuffer();
+	ResultType* PartialData = Partials.GetBuffer();
+	unsigned int ChunkSize = Grain;
+	EspParallelFor(Array.GetCount(), Grain, [Data, PartialData, ChunkSize, &Reduce](unsigned int Begin, unsigned int End)
+		{
+			ResultType& Accumulator = PartialData[Begin / ChunkSize];
+			for (unsigned int TimeNum = Begin; TimeNum < End; TimeNum++)
+				Accumulator = Reduce(std::move(Accumulator), Data[TimeNum]);
+		}, Pool);
+	ResultType Total = Identity;
+	for (unsigned int TimeNum = 0; TimeNum < ChunkCount; TimeNum++)
+		Total = Combine(std::move(Total), std::move(PartialData[TimeNum]));
+	return Total;
+}
+//Appends the elements matching Pred to Result, keeping their order
+template<class EspType, unsigned int InlineCount, unsigned int ResultInlineCount, class PredicateType>
+void ParallelFilter(const EspArray<EspType, InlineCount>& Source, EspArray<EspType, ResultInlineCount>& Result, PredicateType Pred, unsigned int Grain = 0, EspThreadPool& Pool = EspThreadPool::GetDefault())
+{
+	unsigned int ChunkCount = EspGetChunkCount(Source.GetCount(), Grain, Pool);
+	EspArray<EspArray<EspType>> Partials;
+	Partials.Resize(ChunkCount);
+	const EspType* Data = Source.GetBuffer();
+	EspArray<EspType>* PartialData = Partials.GetBuffer();
+	unsigned int ChunkSize = Grain;
+	EspParallelFor(Source.GetCount(), Grain, [Data, PartialData, ChunkSize, &Pred](unsigned int Begin, unsigned int End)
+		{
+			EspArray<EspType>& Matches = PartialData[Begin / ChunkSize];
+			for (unsigned int TimeNum = Begin; TimeNum < End; TimeNum++)
+				if (Pred(Data[TimeNum]))
+					Matches.AddElement(Data[TimeNum]);
+		}, Pool);
+	unsigned int Total = Result.GetCount();
+	for (unsigned int TimeNum = 0; TimeNum < ChunkCount; TimeNum++)
+		Total += PartialData[TimeNum].GetCount();
+	Result.Reserve(Total);
+	for (unsigned int TimeNum = 0; TimeNum < ChunkCount; TimeNum++)
+		Result.InsertRange(Result.GetCount(), PartialData[TimeNum].begin(), PartialData[TimeNum].end());
+}
@@ -0,0 +1,257 @@
+#pragma once
+#include<assert.h>
+#include<atomic>
+#include<memory>
+#include<new>
+#include<stdlib.h>
+#include<thread>
+#if defined(_WIN32)
+#include<Windows.h>
+#pragma comment(lib, "Synchronization.lib")
+#elif defined(__linux__)
+#include<linux/futex.h>
+#include<sys/syscall.h>
+#include<unistd.h>
+#endif
+#ifndef __ESPRINGBUFFER__
+#define __ESPRINGBUFFER__
+#endif
+
+//Bounded single-producer single-consumer queue. Head is only written by the consumer and Tail only by the producer;
+//each side also keeps a private copy of the other index, so the shared cache lines are only read when that copy runs out.
+//The blocking calls spin briefly and then sleep on a per-side signal word (futex on Linux, WaitOnAddress on Windows)
+//that both the other side and Close() bump, so a wake between the last check and the sleep is never lost.
+template<class EspType>
+class EspRingBuffer
+{
+private:
+	static const unsigned int CacheLine = 64;
+	static const unsigned int SpinCount = 256;
+
+	alignas(CacheLine) std::atomic<unsigned int> Head{ 0 };
+	unsigned int CachedTail = 0;
+	alignas(CacheLine) std::atomic<unsigned int> Tail{ 0 };
+	unsigned int CachedHead = 0;
+	alignas(CacheLine) std::atomic<unsigned int> ConsumerWaiting{ 0 };
+	std::atomic<unsigned int> ProducerWaiting{ 0 };
+	std::atomic<unsigned int> DataSignal{ 0 };
+	std::atomic<unsigned int> SpaceSignal{ 0 };
+	std::atomic<bool> Closed{ false };
+	alignas(CacheLine) EspType* Slots = nullptr;
+	unsigned int Mask = 0;
+
+	static void WaitWhileEqual(std::atomic<unsigned int>& Value, unsigned int Expected)
+	{
+#if defined(_WIN32)
+		::WaitOnAddress((volatile void*)&Value, &Expected, sizeof(Expected), INFINITE);
+#elif defined(__linux__)
+		::syscall(SYS_futex, (unsigned int*)&Value, FUTEX_WAIT_PRIVATE, Expected, NULL, NULL, 0);
+#else
+		if (Value.load() == Expected)
+			std::this_thread::yield();
+#endif
+	}
+	static void WakeAll(std::atomic<unsigned int>& Value)
+	{
+#if defined(_WIN32)
+		::WakeByAddressAll((void*)&Value);
+#elif defined(__linux__)
+		::syscall(SYS_futex, (unsigned int*)&Value, FUTEX_WAKE_PRIVATE, 0x7FFFFFFF, NULL, NULL, 0);
+#endif
+	}
+	//Sleeps until Index moves away from Observed, unless it already has; Waiting tells the other side to bump Signal.
+	//Signal is read before the last check, so a bump after that check makes the wait return at once.
+	void Sleep(std::atomic<unsigned int>& Index, unsigned int Observed, std::atomic<unsigned int>& Waiting, std::atomic<unsigned int>& Signal)
+	{
+		for (unsigned int TimeNum = 0; TimeNum < SpinCount; TimeNum++)
+			if (Index.load(std::memory_order_acquire) != Observed || Closed.load(std::memory_order_acquire))
+				return;
+		Waiting.store(1, std::memory_order_seq_cst);
+		unsigned int Sequence = Signal.load(std::memory_order_seq_cst);
+		if (Index.load(std::memory_order_seq_cst) == Observed && !Closed.load(std::memory_order_seq_cst))
+			EspRingBuffer::WaitWhileEqual(Signal, Sequence);
+		Waiting.store(0, std::memory_order_relaxed);
+	}
+	static void Notify(std::atomic<unsigned int>& Signal)
+	{
+		Signal.fetch_add(1, std::memory_order_seq_cst);
+		EspRingBuffer::WakeAll(Signal);
+	}
+	void Publish(std::atomic<unsigned int>& Index, unsigned int NewValue, std::atomic<unsigned int>& Waiting, std::atomic<unsigned int>& Signal)
+	{
+		Index.store(NewValue, std::memory_order_release);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (Waiting.load(std::memory_order_relaxed) != 0)
+			EspRingBuffer::Notify(Signal);
+	}
+	//The queue was seen full, i.e. Head == Tail - Capacity, or empty, i.e. Tail == Head
+	void WaitForSpace() { Sleep(Head, Tail.load(std::memory_order_relaxed) - (Mask + 1), ProducerWaiting, SpaceSignal); }
+	void WaitForData() { Sleep(Tail, Head.load(std::memory_order_relaxed), ConsumerWaiting, DataSignal); }
+	unsigned int GetFreeCount()
+	{
+		unsigned int Position = Tail.load(std::memory_order_relaxed);
+		if (Position - CachedHead > Mask)
+			CachedHead = Head.load(std::memory_order_acquire);
+		return Mask + 1 - (Position - CachedHead);
+	}
+	unsigned int GetReadyCount()
+	{
+		unsigned int Position = Head.load(std::memory_order_relaxed);
+		if (CachedTail == Position)
+			CachedTail = Tail.load(std::memory_order_acquire);
+		return CachedTail - Position;
+	}
+
+public:
+	//Capacity is rounded up to a power of two, at most 2^31
+	EspRingBuffer(unsigned int nCapacity = 1024)
+	{
+		assert(nCapacity <= 0x80000000u);
+		unsigned int Capacity = 2;
+		while (Capacity < nCapacity && Capacity < 0x80000000u)
+			Capacity *= 2;
+		Slots = (EspType*)::malloc(Capacity * sizeof(EspType));
+		if (Slots == NULL)
+			throw("Allocate Buffer Unsuccessfully!");
+		Mask = Capacity - 1;
+	}
+	EspRingBuffer(const EspRingBuffer&) = delete;
+	const EspRingBuffer& operator=(const EspRingBuffer&) = delete;
+	~EspRingBuffer()
+	{
+		for (unsigned int Position = Head.load(); Position != Tail.load(); Position++)
+			(Slots + (Position & Mask))->~EspType();
+		::free(Slots);
+	}
+
+	//Producer side
+	template<class... ArgTypes>
+	bool TryEmplace(ArgTypes&&... Args)
+	{
+		if (GetFreeCount() == 0)
+			return false;
+		unsigned int Position = Tail.load(std::memory_order_relaxed);
+		::new(Slots + (Position & Mask))EspType(std::forward<ArgTypes>(Args)...);
+		Publish(Tail, Position + 1, ConsumerWaiting, DataSignal);
+		return true;
+	}
+	bool TryPush(const EspType& NewElement) { return TryEmplace(NewElement); }
+	bool TryPush(EspType&& NewElement) { return TryEmplace(std::move(NewElement)); }
+	//Copies as many of the elements as fit and publishes them at once; returns how many were pushed
+	unsigned int TryPushBatch(const EspType* NewElements, unsigned int nCount)
+	{
+		unsigned int Free = GetFreeCount();
+		unsigned int Count = nCount < Free ? nCount : Free;
+		if (Count == 0)
+			return 0;
+		unsigned int Position = Tail.load(std::memory_order_relaxed);
+		for (unsigned int TimeNum = 0; TimeNum < Count; TimeNum++)
+			::new(Slots + ((Position + TimeNum) & Mask))EspType(NewElements[TimeNum]);
+		Publish(Tail, Position + Count, ConsumerWaiting, DataSignal);
+		return Count;
+	}
+	//Blocks while the queue is full; returns false without pushing if another thread closes it meanwhile
+	bool Push(const EspType& NewElement)
+	{
+		while (!TryPush(NewElement))
+		{
+			if (Closed.load(std::memory_order_acquire))
+				return false;
+			WaitForSpace();
+		}
+		return true;
+	}
+	bool Push(EspType&& NewElement)
+	{
+		while (!TryPush(std::move(NewElement)))
+		{
+			if (Closed.load(std::memory_order_acquire))
+				return false;
+			WaitForSpace();
+		}
+		return true;
+	}
+	//Returns how many were pushed, which is less than nCount only if the queue was closed while waiting
+	unsigned int PushBatch(const EspType* NewElements, unsigned int nCount)
+	{
+		unsigned int Total = 0;
+		while (Total < nCount)
+		{
+			unsigned int Pushed = TryPushBatch(NewElements + Total, nCount - Total);
+			Total += Pushed;
+			if (Total < nCount && Pushed == 0)
+			{
+				if (Closed.load(std::memory_order_acquire))
+					break;
+				WaitForSpace();
+			}
+		}
+		return Total;
+	}
+	//Tells the consumer no more elements will come; blocked and later Pop calls return false once the queue is drained.
+	//Both sides are woken, so a producer blocked on a full queue retries as well.
+	void Close()
+	{
+		Closed.store(true, std::memory_order_seq_cst);
+		EspRingBuffer::Notify(DataSignal);
+		EspRingBuffer::Notify(SpaceSignal);
+	}
+
+	//Consumer side
+	bool TryPop(EspType& Element)
+	{
+		if (GetReadyCount() == 0)
+			return false;
+		unsigned int Position = Head.load(std::memory_order_relaxed);
+		EspType* Slot = Slots + (Position & Mask);
+		Element = std::move(*Slot);
+		Slot->~EspType();
+		Publish(Head, Position + 1, ProducerWaiting, SpaceSignal);
+		return true;
+	}
+	unsigned int TryPopBatch(EspType* Elements, unsigned int nMaxCount)
+	{
+		unsigned int Ready = GetReadyCount();
+		unsigned int Count = nMaxCount < Ready ? nMaxCount : Ready;
+		if (Count == 0)
+			return 0;
+		unsigned int Position = Head.load(std::memory_order_relaxed);
+		for (unsigned int TimeNum = 0; TimeNum < Count; TimeNum++)
+		{
+			EspType* Slot = Slots + ((Position + TimeNum) & Mask);
+			Elements[TimeNum] = std::move(*Slot);
+			Slot->~EspType();
+		}
+		Publish(Head, Position + Count, ProducerWaiting, SpaceSignal);
+		return Count;
+	}
+	//Blocks until an element arrives; returns false when the queue is closed and empty
+	bool Pop(EspType& Element)
+	{
+		while (!TryPop(Element))
+		{
+			if (Closed.load(std::memory_order_acquire) && GetReadyCount() == 0)
+				return false;
+			WaitForData();
+		}
+		return true;
+	}
+	//Blocks until at least one element arrives, then takes up to nMaxCount; returns 0 when closed and empty
+	unsigned int PopBatch(EspType* Elements, unsigned int nMaxCount)
+	{
+		while (true)
+		{
+			unsigned int Count = TryPopBatch(Elements, nMaxCount);
+			if (Count > 0 || nMaxCount == 0)
+				return Count;
+			if (Closed.load(std::memory_order_acquire) && GetReadyCount() == 0)
+				return 0;
+			WaitForData();
+		}
+	}
+
+	unsigned int GetCapacity()const { return Mask + 1; }
+	//Exact only when called from the producer or consumer thread with the other side idle
+	unsigned int GetCount()const { return Tail.load(std::memory_order_acquire) - Head.load(std::memory_order_acquire); }
+	bool IsClosed()const { return Closed.load(std::memory_order_acquire); }
+};
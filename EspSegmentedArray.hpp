@@ -0,0 +1,250 @@
+#pragma once
+#include<assert.h>
+#include<memory>
+#include<iterator>
+#include<new>
+#include<type_traits>
+#ifndef __ESPSEGMENTEDARRAY__
+#define __ESPSEGMENTEDARRAY__
+#endif
+
+//Block K holds FirstBlockSize << K elements, so element Index lives in block floor(log2(Index + FirstBlockSize)) - FirstBlockShift
+template<unsigned int FirstBlockShift>
+struct EspSegmentLayout
+{
+	static const unsigned int FirstBlockSize = 1u << FirstBlockShift;
+	static const unsigned int MaxBlockCount = 32 - FirstBlockShift;
+
+	static unsigned int HighestBit(unsigned int Value)
+	{
+#if defined(_MSC_VER)
+		unsigned long Index;
+		_BitScanReverse(&Index, Value);
+		return Index;
+#else
+		return 31 - __builtin_clz(Value);
+#endif
+	}
+	static unsigned int GetBlockSize(unsigned int Block) { return FirstBlockSize << Block; }
+	static unsigned int GetBlockStart(unsigned int Block) { return (FirstBlockSize << Block) - FirstBlockSize; }
+	static void Locate(unsigned int Index, unsigned int& Block, unsigned int& Offset)
+	{
+		unsigned int Position = Index + FirstBlockSize;
+		unsigned int High = EspSegmentLayout::HighestBit(Position);
+		Block = High - FirstBlockShift;
+		Offset = Position - (1u << High);
+	}
+};
+
+//Blocks are never moved or reallocated: growth only appends a block, and element addresses stay valid until the element is removed.
+template<class EspType, unsigned int FirstBlockShift = 5>
+class EspSegmentedArray
+{
+private:
+	typedef EspSegmentLayout<FirstBlockShift> Layout;
+	static const unsigned int MaxBlockCount = Layout::MaxBlockCount;
+
+	EspType* Blocks[MaxBlockCount] = {};
+	unsigned int BlockCount = 0;
+	unsigned int ArraySize = 0;
+
+	void AddBlock()
+	{
+		assert(BlockCount < MaxBlockCount);
+		EspType* NewBlock = (EspType*)::malloc(Layout::GetBlockSize(BlockCount) * sizeof(EspType));
+		if (NewBlock == NULL)
+			throw("Allocate Buffer Unsuccessfully!");
+		Blocks[BlockCount++] = NewBlock;
+	}
+	EspType* GetSlot(unsigned int Index)
+	{
+		unsigned int Block, Offset;
+		Layout::Locate(Index, Block, Offset);
+		while (Block >= BlockCount)
+			AddBlock();
+		return Blocks[Block] + Offset;
+	}
+
+public:
+	template<bool IsConst>
+	class EspSegmentedIterator
+	{
+	private:
+		typedef typename std::conditional<IsConst, const EspSegmentedArray, EspSegmentedArray>::type ArrayType;
+		ArrayType* Array;
+		unsigned int Index;
+		unsigned int Block;
+		EspType* Pos;
+		EspType* BlockEnd;
+
+	public:
+		typedef std::forward_iterator_tag iterator_category;
+		typedef EspType value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef typename std::conditional<IsConst, const EspType*, EspType*>::type pointer;
+		typedef typename std::conditional<IsConst, const EspType&, EspType&>::type reference;
+
+		EspSegmentedIterator(ArrayType* Array, unsigned int Index) :Array(Array), Index(Index), Pos(NULL), BlockEnd(NULL)
+		{
+			if (Index < Array->ArraySize)
+			{
+				unsigned int Offset;
+				Layout::Locate(Index, Block, Offset);
+				Pos = Array->Blocks[Block] + Offset;
+				BlockEnd = Array->Blocks[Block] + Layout::GetBlockSize(Block);
+			}
+		}
+		reference operator*()const { return *Pos; }
+		pointer operator->()const { return Pos; }
+		EspSegmentedIterator& operator++()
+		{
+			if (++Index < Array->ArraySize && ++Pos == BlockEnd)
+			{
+				Block++;
+				Pos = Array->Blocks[Block];
+				BlockEnd = Pos + Layout::GetBlockSize(Block);
+			}
+			return *this;
+		}
+		EspSegmentedIterator operator++(int)
+		{
+			EspSegmentedIterator Old(*this);
+			++*this;
+			return Old;
+		}
+		unsigned int GetIndex()const { return Index; }
+		bool operator==(const EspSegmentedIterator& Iterator)const { return Index == Iterator.Index; }
+		bool operator!=(const EspSegmentedIterator& Iterator)const { return Index != Iterator.Index; }
+	};
+	typedef EspSegmentedIterator<false> Iterator;
+	typedef EspSegmentedIterator<true> ConstIterator;
+
+	EspSegmentedArray() {}
+	EspSegmentedArray(const EspSegmentedArray& NewArray) { AddArray(NewArray); }
+	EspSegmentedArray(EspSegmentedArray&& NewArray)
+	{
+		::memcpy(Blocks, NewArray.Blocks, sizeof(Blocks));
+		BlockCount = NewArray.BlockCount;
+		ArraySize = NewArray.ArraySize;
+		::memset(NewArray.Blocks, 0, sizeof(NewArray.Blocks));
+		NewArray.BlockCount = NewArray.ArraySize = 0;
+	}
+	~EspSegmentedArray()
+	{
+		Empty();
+		ShrinkToFit();
+	}
+	const EspSegmentedArray& operator=(const EspSegmentedArray& NewArray)
+	{
+		if (&NewArray != this)
+		{
+			Empty();
+			AddArray(NewArray);
+		}
+		return *this;
+	}
+	const EspSegmentedArray& operator=(EspSegmentedArray&& NewArray)
+	{
+		if (&NewArray != this)
+		{
+			this->~EspSegmentedArray();
+			::new(this)EspSegmentedArray(std::move(NewArray));
+		}
+		return *this;
+	}
+
+	void Reserve(unsigned int NewAllocSize)
+	{
+		if (NewAllocSize > 0)
+			GetSlot(NewAllocSize - 1);
+	}
+	template<class... ArgTypes>
+	EspType& Emplace(ArgTypes&&... Args)
+	{
+		EspType* Slot = GetSlot(ArraySize);
+		::new(Slot)EspType(std::forward<ArgTypes>(Args)...);
+		ArraySize++;
+		return *Slot;
+	}
+	void AddElement(const EspType& NewElement) { Emplace(NewElement); }
+	void AddElement(EspType&& NewElement) { Emplace(std::move(NewElement)); }
+	void AddArray(const EspSegmentedArray& NewArray)
+	{
+		unsigned int NewCount = NewArray.ArraySize;
+		Reserve(ArraySize + NewCount);
+		for (unsigned int TimeNum = 0; TimeNum < NewCount; TimeNum++)
+			AddElement(NewArray.GetElementAt(TimeNum));
+	}
+	//Destroys the last Count elements; the blocks are kept for reuse
+	void DeleteLast(unsigned int Count = 1)
+	{
+		assert(Count <= ArraySize);
+		for (unsigned int TimeNum = 0; TimeNum < Count; TimeNum++)
+		{
+			GetElementAt(ArraySize - 1).~EspType();
+			ArraySize--;
+		}
+	}
+
+	EspType& GetElementAt(unsigned int Index)const
+	{
+		assert(Index < ArraySize);
+		unsigned int Block, Offset;
+		Layout::Locate(Index, Block, Offset);
+		return Blocks[Block][Offset];
+	}
+	EspType& operator[](unsigned int Index)const { return GetElementAt(Index); }
+	void SetElementAt(unsigned int Index, const EspType& NewElement) { GetElementAt(Index) = NewElement; }
+	void SetElementAt(unsigned int Index, EspType&& NewElement) { GetElementAt(Index) = std::move(NewElement); }
+	unsigned int GetCount()const { return ArraySize; }
+	unsigned int GetBufSize()const { return BlockCount > 0 ? Layout::GetBlockStart(BlockCount) : 0; }
+	unsigned int GetBlockCount()const { return BlockCount; }
+	bool IsEmpty()const { return ArraySize == 0; }
+
+	Iterator begin() { return Iterator(this, 0); }
+	Iterator end() { return Iterator(this, ArraySize); }
+	ConstIterator begin()const { return ConstIterator(this, 0); }
+	ConstIterator end()const { return ConstIterator(this, ArraySize); }
+
+	//Calls Func(EspType* Data, unsigned int Count, unsigned int FirstIndex) once per used block, in order
+	template<class FuncType>
+	void ForEachBlock(FuncType Func)const
+	{
+		for (unsigned int Block = 0; Block < BlockCount; Block++)
+		{
+			unsigned int Start = Layout::GetBlockStart(Block);
+			if (Start >= ArraySize)
+				break;
+			unsigned int Count = Layout::GetBlockSize(Block);
+			Func(Blocks[Block], Count < ArraySize - Start ? Count : ArraySize - Start, Start);
+		}
+	}
+	template<class FuncType>
+	void ForEach(FuncType Func)const
+	{
+		ForEachBlock([&Func](EspType* Data, unsigned int Count, unsigned int)
+			{
+				for (unsigned int TimeNum = 0; TimeNum < Count; TimeNum++)
+					Func(Data[TimeNum]);
+			});
+	}
+
+	void Empty()
+	{
+		ForEachBlock([](EspType* Data, unsigned int Count, unsigned int)
+			{
+				for (unsigned int TimeNum = 0; TimeNum < Count; TimeNum++)
+					(Data + TimeNum)->~EspType();
+			});
+		ArraySize = 0;
+	}
+	//Frees the blocks past the last element
+	void ShrinkToFit()
+	{
+		while (BlockCount > 0 && Layout::GetBlockStart(BlockCount - 1) >= ArraySize)
+		{
+			::free(Blocks[--BlockCount]);
+			Blocks[BlockCount] = NULL;
+		}
+	}
+};
@@ -1,5 +1,23 @@
 #pragma once
 #include<memory>
+#include<atomic>
+#include<thread>
+#if defined(_MSC_VER)
+#include<intrin.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include<emmintrin.h>
+#define __ESPSTRING_SSE2__
+#endif
+//GCC and Clang only emit SSSE3 under -mssse3 (or -mavx); MSVC emits it without /arch:AVX, so there the validator checks cpuid at run time
+#if defined(__ESPSTRING_SSE2__) && (defined(__SSSE3__) || defined(__AVX__))
+#include<tmmintrin.h>
+#define __ESPSTRING_SSSE3__
+#elif defined(__ESPSTRING_SSE2__) && defined(_MSC_VER) && !defined(__clang__)
+#include<tmmintrin.h>
+#define __ESPSTRING_SSSE3__
+#define __ESPSTRING_SSSE3_CPUID__
+#endif
 #ifndef __ESPSTRING__
 #define __ESPSTRING__
 #endif
@@ -16,25 +34,63 @@ public:
 	static unsigned int ReverseFind(const char* lpszStr, const char* lpszSub, unsigned int nEndPos = 0);
 	static bool Compare(const char* lpszStr1, const char* lpszStr2);
 	static bool CompareNoCase(const char* lpszStr1, const char* lpszStr2);
+	static int CompareOrdinal(const char* lpszStr1, unsigned int nLength1, const char* lpszStr2, unsigned int nLength2);
 	static void Reverse(char* lpszStr);
+	static unsigned long long Hash(const char* lpszData, unsigned int nLength, unsigned long long nSeed = 0);
+	static bool IsValidUtf8(const char* lpszStr, unsigned int nLength);
+	static unsigned int CountCodePoints(const char* lpszStr, unsigned int nLength);
+	static bool FromUtf16(const unsigned short* lpszWStr, unsigned int nLength, EspString& Result);
 
 private:
 	char* Buffer = nullptr;
 	unsigned int StrLen = 0;
 	unsigned int BufSize = 0;
+	//Filled lazily by GetHash()const, which may run on several threads at once, so it is atomic; 0 means not computed
+	mutable std::atomic<unsigned long long> HashCache{ 0 };
+
+	void ResetHash() { HashCache.store(0, std::memory_order_relaxed); }
+	static unsigned long long HashMix(unsigned long long A, unsigned long long B);
+	static unsigned long long HashRead8(const unsigned char* Pos) { unsigned long long V; ::memcpy(&V, Pos, 8); return V; }
+	static unsigned long long HashRead4(const unsigned char* Pos) { unsigned int V; ::memcpy(&V, Pos, 4); return V; }
+	static unsigned int CountBits(unsigned int Mask);
+	static bool IsValidUtf8Scalar(const unsigned char* Pos, const unsigned char* End);
+#if defined(__ESPSTRING_SSE2__)
+	static bool IsValidUtf8Sse2(const unsigned char* Pos, const unsigned char* End);
+#endif
+#if defined(__ESPSTRING_SSSE3__)
+	static bool IsValidUtf8Ssse3(const unsigned char* Pos, const unsigned char* End);
+#endif
+#if defined(__ESPSTRING_SSSE3_CPUID__)
+	static bool CpuHasSsse3() { int Info[4]; __cpuid(Info, 1); return (Info[2] & (1 << 9)) != 0; }
+#endif
+
+	//Read by every growing string, so it is atomic and may be changed while other threads append
+	static std::atomic<double>& GrowthFactorRef() { static std::atomic<double> GrowthFactor(2.0); return GrowthFactor; }
+	void ReallocBuffer(unsigned int NewBufSize);
+	void GrowBuffer(unsigned int NewStrLen);
+	EspString& AppendRaw(const char* lpszNewStr, unsigned int NewStrLen);
+	EspString& AssignRaw(const char* lpszNewStr, unsigned int NewStrLen);
 public:
+	typedef void EspRelocatable;
+	static double GetGrowthFactor() { return EspString::GrowthFactorRef().load(std::memory_order_relaxed); }
+	static void SetGrowthFactor(double GrowthFactor) { EspString::GrowthFactorRef().store(GrowthFactor > 1.0 ? GrowthFactor : 1.0, std::memory_order_relaxed); }
+
 	EspString();
 	EspString(unsigned int BufferSize, bool Doubled = false);
 	EspString(const char* lpszNewStr, bool DoubledBuf = false);
 	EspString(const EspString& lpszNewStr, bool DoubleBuf = false);
+	EspString(EspString&& lpszNewStr);
 	~EspString();
 
 	const char* GetAnsiStr()const;
 	operator const char* ()const;
 	char* GetBuffer()const;
 	char* GetBuffer(unsigned int NewBufSize);
-	EspString& RefreshLength() { StrLen = EspString::GetLength(Buffer); return *this; };
+	//Call after writing through a pointer from GetBuffer, GetCharAt or operator[]: it resets the length and the cached hash
+	EspString& RefreshLength() { StrLen = EspString::GetLength(Buffer); ResetHash(); return *this; };
 	char* GetBufferSetLength(unsigned int NewStrLen, bool Doubled = false);
+	void Reserve(unsigned int nLength);
+	void ShrinkToFit();
 	const unsigned int GetLength()const;
 	const unsigned int GetUpperIndex()const;
 	const unsigned int GetBufSize()const;
@@ -60,10 +116,17 @@ public:
 	bool Compare(const EspString& lpszStr)const;
 	bool CompareNoCase(const char* lpszStr)const;
 	bool CompareNoCase(const EspString& lpszStr)const;
+	int CompareOrdinal(const EspString& lpszStr)const;
+	bool operator<(const EspString& lpszStr)const { return CompareOrdinal(lpszStr) < 0; }
+	unsigned long long GetHash()const;
+	bool IsValidUtf8()const;
+	unsigned int GetCodePointCount()const;
+	unsigned int ToUtf16(unsigned short* lpszWBuffer, unsigned int nBufLength)const;
 
 	EspString& Append(const char& lpszChar);
 	EspString& Append(const char* lpszNewStr);
 	EspString& Append(const EspString& lpszNewStr);
+	EspString& Append(const char* lpszNewStr, unsigned int nLength);
 
 	EspString& operator+=(const char& lpszChar);
 	EspString& operator+=(const char* lpszNewStr);
@@ -71,9 +134,11 @@ public:
 
 	EspString& Assign(const char* lpszNewStr);
 	EspString& Assign(const EspString& lpszNewStr);
+	EspString& Assign(const char* lpszNewStr, unsigned int nLength);
 
 	EspString& operator=(const char* lpszNewStr);
 	EspString& operator=(const EspString& lpszNewStr);
+	EspString& operator=(EspString&& lpszNewStr);
 
 	EspString& Insert(unsigned int nIndex, const char& lpszChar, unsigned int nCount = 1);
 	EspString& Insert(unsigned int nIndex, const char* lpszNewStr);
@@ -87,13 +152,15 @@ public:
 	EspString& Replace(const char* lpszOldStr, const char* lpszNewStr);
 
 	EspString& Reverse();
+	void Swap(EspString& lpszStr);
 
 	void Empty()
 	{
 		if (Buffer != NULL)
 		{
-			::memset(Buffer, 0, BufSize * sizeof(char));
+			Buffer[0] = '\0';
 			StrLen = 0;
+			ResetHash();
 		}
 	}
 
@@ -229,6 +296,14 @@ bool EspString::CompareNoCase(const char* lpszStr1, const char* lpszStr2)
 	while (*lpszStr1 && (EspString::CharToLower(*lpszStr1) == EspString::CharToLower(*lpszStr2)))lpszStr1++, lpszStr2++;
 	return (EspString::CharToLower(*lpszStr1) - EspString::CharToLower(*lpszStr2)) == 0;
 }
+int EspString::CompareOrdinal(const char* lpszStr1, unsigned int nLength1, const char* lpszStr2, unsigned int nLength2)
+{
+	unsigned int MinLength = nLength1 < nLength2 ? nLength1 : nLength2;
+	int Result = MinLength > 0 ? ::memcmp(lpszStr1, lpszStr2, MinLength) : 0;
+	if (Result != 0)
+		return Result;
+	return nLength1 < nLength2 ? -1 : (nLength1 > nLength2 ? 1 : 0);
+}
 void EspString::Reverse(char* lpszStr)
 {
 	char* lpszStart, * lpszEnd;
@@ -240,6 +315,74 @@ void EspString::Reverse(char* lpszStr)
 		*lpszStart ^= *lpszEnd;
 	}
 }
+unsigned long long EspString::HashMix(unsigned long long A, unsigned long long B)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+	unsigned long long High;
+	unsigned long long Low = _umul128(A, B, &High);
+	return Low ^ High;
+#elif defined(__SIZEOF_INT128__)
+	unsigned __int128 Product = (unsigned __int128)A * B;
+	return (unsigned long long)Product ^ (unsigned long long)(Product >> 64);
+#else
+	unsigned long long HighA = A >> 32, LowA = (unsigned int)A, HighB = B >> 32, LowB = (unsigned int)B;
+	unsigned long long HighHigh = HighA * HighB, HighLow = HighA * LowB, LowHigh = LowA * HighB, LowLow = LowA * LowB;
+	unsigned long long Middle = (LowLow >> 32) + (unsigned int)HighLow + (unsigned int)LowHigh;
+	unsigned long long Low = (Middle << 32) | (unsigned int)LowLow;
+	unsigned long long High = HighHigh + (HighLow >> 32) + (LowHigh >> 32) + (Middle >> 32);
+	return Low ^ High;
+#endif
+}
+unsigned long long EspString::Hash(const char* lpszData, unsigned int nLength, unsigned long long nSeed)
+{
+	//wyhash-style: 48-byte unrolled body, overlapping loads for the tail
+	const unsigned long long Secret0 = 0xa0761d6478bd642full, Secret1 = 0xe7037ed1a0b428dbull;
+	const unsigned long long Secret2 = 0x8ebc6af09c88c6e3ull, Secret3 = 0x589965cc75374cc3ull;
+	const unsigned char* Pos = (const unsigned char*)lpszData;
+	unsigned long long Seed = nSeed ^ EspString::HashMix(nSeed ^ Secret0, Secret1);
+	unsigned long long A, B;
+	if (nLength <= 16)
+	{
+		if (nLength >= 4)
+		{
+			A = (EspString::HashRead4(Pos) << 32) | EspString::HashRead4(Pos + ((nLength >> 3) << 2));
+			B = (EspString::HashRead4(Pos + nLength - 4) << 32) | EspString::HashRead4(Pos + nLength - 4 - ((nLength >> 3) << 2));
+		}
+		else if (nLength > 0)
+		{
+			A = ((unsigned long long)Pos[0] << 16) | ((unsigned long long)Pos[nLength >> 1] << 8) | Pos[nLength - 1];
+			B = 0;
+		}
+		else
+			A = B = 0;
+	}
+	else
+	{
+		unsigned int Remain = nLength;
+		if (Remain > 48)
+		{
+			unsigned long long Seed1 = Seed, Seed2 = Seed;
+			do
+			{
+				Seed = EspString::HashMix(EspString::HashRead8(Pos) ^ Secret1, EspString::HashRead8(Pos + 8) ^ Seed);
+				Seed1 = EspString::HashMix(EspString::HashRead8(Pos + 16) ^ Secret2, EspString::HashRead8(Pos + 24) ^ Seed1);
+				Seed2 = EspString::HashMix(EspString::HashRead8(Pos + 32) ^ Secret3, EspString::HashRead8(Pos + 40) ^ Seed2);
+				Pos += 48;
+				Remain -= 48;
+			} while (Remain > 48);
+			Seed ^= Seed1 ^ Seed2;
+		}
+		while (Remain > 16)
+		{
+			Seed = EspString::HashMix(EspString::HashRead8(Pos) ^ Secret1, EspString::HashRead8(Pos + 8) ^ Seed);
+			Pos += 16;
+			Remain -= 16;
+		}
+		A = EspString::HashRead8(Pos + Remain - 16);
+		B = EspString::HashRead8(Pos + Remain - 8);
+	}
+	return EspString::HashMix(Secret1 ^ nLength, EspString::HashMix(A ^ Secret1, B ^ Seed));
+}
 
 EspString::EspString() {}
 EspString::EspString(unsigned int BufferSize, bool Doubled)
@@ -247,52 +390,46 @@ EspString::EspString(unsigned int BufferSize, bool Doubled)
 	unsigned int NewBufSize = BufferSize;
 	if (Doubled)
 		NewBufSize *= 2;
-	Buffer = (char*)::malloc(NewBufSize * sizeof(char));
-	if (Buffer == NULL)
-		throw("Allocate Buffer Unsuccessfully");
-	::memset(Buffer, 0, NewBufSize * sizeof(char));
-	StrLen = 0;
-	BufSize = NewBufSize;
+	if (NewBufSize == 0)
+		return;
+	ReallocBuffer(NewBufSize);
 }
 EspString::EspString(const char* lpszNewStr, bool DoubledBuf)
 {
 	if (lpszNewStr == NULL)
-	{
-		Buffer = NULL;
-		BufSize = StrLen = 0;
 		return;
-	}
 	unsigned int NewStrLen = EspString::GetLength(lpszNewStr);
 	unsigned int NewBufSize = NewStrLen + 1;
 	if (DoubledBuf)
 		NewBufSize *= 2;
-	Buffer = (char*)::malloc(NewBufSize * sizeof(char));
-	if (Buffer == NULL)
-		throw("Allocate Buffer Unsuccessfully");
+	ReallocBuffer(NewBufSize);
 	::memcpy(Buffer, lpszNewStr, NewStrLen * sizeof(char));
-	::memset(Buffer + NewStrLen, 0, (NewBufSize - NewStrLen) * sizeof(char));
+	Buffer[NewStrLen] = '\0';
 	StrLen = NewStrLen;
-	BufSize = NewBufSize;
 }
 EspString::EspString(const EspString& lpszNewStr, bool DoubleBuf)
 {
 	if (lpszNewStr.Buffer == NULL)
-	{
-		Buffer = NULL;
-		BufSize = StrLen = 0;
 		return;
-	}
 	unsigned int NewStrLen = lpszNewStr.StrLen;
 	unsigned int NewBufSize = NewStrLen + 1;
 	if (DoubleBuf)
 		NewBufSize *= 2;
-	Buffer = (char*)::malloc(NewBufSize * sizeof(char));
-	if (Buffer == NULL)
-		throw("Allocate Buffer Unsuccessfully");
+	ReallocBuffer(NewBufSize);
 	::memcpy(Buffer, lpszNewStr.Buffer, NewStrLen * sizeof(char));
-	::memset(Buffer + NewStrLen, 0, (NewBufSize - NewStrLen) * sizeof(char));
+	Buffer[NewStrLen] = '\0';
 	StrLen = NewStrLen;
-	BufSize = NewBufSize;
+	HashCache.store(lpszNewStr.HashCache.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+EspString::EspString(EspString&& lpszNewStr)
+{
+	Buffer = lpszNewStr.Buffer;
+	StrLen = lpszNewStr.StrLen;
+	BufSize = lpszNewStr.BufSize;
+	HashCache.store(lpszNewStr.HashCache.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	lpszNewStr.Buffer = NULL;
+	lpszNewStr.StrLen = lpszNewStr.BufSize = 0;
+	lpszNewStr.ResetHash();
 }
 EspString::~EspString()
 {
@@ -301,37 +438,99 @@ EspString::~EspString()
 	Buffer = NULL;
 }
 
-const char* EspString::GetAnsiStr()const { return Buffer; }
-EspString::operator const char* ()const { return Buffer; }
-char* EspString::GetBuffer()const { return Buffer; }
-char* EspString::GetBuffer(unsigned int NewBufSize)
+void EspString::ReallocBuffer(unsigned int NewBufSize)
 {
-	if (Buffer == NULL)
+	//There must always be room for the terminator
+	if (NewBufSize == 0)
+		NewBufSize = 1;
+	char* NewBuffer = (char*)::realloc(Buffer, NewBufSize * sizeof(char));
+	if (NewBuffer == NULL)
+		throw("Allocate Buffer Unsuccessfully");
+	Buffer = NewBuffer;
+	BufSize = NewBufSize;
+	ResetHash();
+	if (StrLen >= BufSize)
+		StrLen = BufSize - 1;
+	Buffer[StrLen] = '\0';
+}
+void EspString::GrowBuffer(unsigned int NewStrLen)
+{
+	if (NewStrLen < BufSize)
+		return;
+	double GrownSize = (double)NewStrLen * EspString::GetGrowthFactor();
+	unsigned int NewBufSize = GrownSize > (double)(NewStrLen + 1) ? (unsigned int)GrownSize : NewStrLen + 1;
+	ReallocBuffer(NewBufSize);
+}
+EspString& EspString::AppendRaw(const char* lpszNewStr, unsigned int NewStrLen)
+{
+	unsigned int TotalStrLen = StrLen + NewStrLen;
+	if (TotalStrLen >= BufSize)
 	{
-		Buffer = (char*)::malloc(NewBufSize * sizeof(char));
-		if (Buffer == NULL)
-			throw("Allocate Buffer Unsuccessfully");
-		::memset(Buffer, 0, NewBufSize * sizeof(char));
-		BufSize = NewBufSize;
+		if (Buffer != NULL && lpszNewStr >= Buffer && lpszNewStr < Buffer + BufSize)
+		{
+			unsigned int SelfOffset = lpszNewStr - Buffer;
+			GrowBuffer(TotalStrLen);
+			lpszNewStr = Buffer + SelfOffset;
+		}
+		else if (Buffer == NULL)
+			ReallocBuffer(TotalStrLen + 1);
+		else
+			GrowBuffer(TotalStrLen);
 	}
-	else if (NewBufSize >= BufSize)
+	::memcpy(Buffer + StrLen, lpszNewStr, NewStrLen * sizeof(char));
+	StrLen = TotalStrLen;
+	Buffer[StrLen] = '\0';
+	ResetHash();
+	return *this;
+}
+EspString& EspString::AssignRaw(const char* lpszNewStr, unsigned int NewStrLen)
+{
+	if (Buffer == NULL)
+		ReallocBuffer(NewStrLen + 1);
+	else if (NewStrLen >= BufSize)
 	{
-		char* NewBuffer = (char*)::malloc(NewBufSize * sizeof(char));
-		if (NewBuffer == NULL)
-			throw("Allocate Buffer Unsuccessfully");
-		::memcpy(NewBuffer, Buffer, StrLen * sizeof(char));
-		::memset(NewBuffer + StrLen, 0, (NewBufSize - StrLen) * sizeof(char));
+		//The old text is overwritten anyway, so free it instead of letting realloc copy it
 		::free(Buffer);
-		Buffer = NewBuffer;
-		BufSize = NewBufSize;
+		Buffer = NULL;
+		StrLen = BufSize = 0;
+		GrowBuffer(NewStrLen);
 	}
+	::memmove(Buffer, lpszNewStr, NewStrLen * sizeof(char));
+	StrLen = NewStrLen;
+	Buffer[StrLen] = '\0';
+	ResetHash();
+	return *this;
+}
+
+const char* EspString::GetAnsiStr()const { return Buffer; }
+EspString::operator const char* ()const { return Buffer; }
+char* EspString::GetBuffer()const { return Buffer; }
+char* EspString::GetBuffer(unsigned int NewBufSize)
+{
+	ResetHash();
+	if (Buffer == NULL || NewBufSize > BufSize)
+		ReallocBuffer(NewBufSize);
 	return Buffer;
 }
 char* EspString::GetBufferSetLength(unsigned int NewStrLen, bool Doubled)
 {
-	StrLen = NewStrLen++;
-	NewStrLen = Doubled ? NewStrLen * 2 : NewStrLen;
-	return GetBuffer(NewStrLen);
+	unsigned int NewBufSize = NewStrLen + 1;
+	if (Doubled)
+		NewBufSize *= 2;
+	GetBuffer(NewBufSize);
+	StrLen = NewStrLen;
+	Buffer[StrLen] = '\0';
+	return Buffer;
+}
+void EspString::Reserve(unsigned int nLength)
+{
+	if (Buffer == NULL || nLength >= BufSize)
+		ReallocBuffer(nLength + 1);
+}
+void EspString::ShrinkToFit()
+{
+	if (Buffer != NULL && StrLen + 1 < BufSize)
+		ReallocBuffer(StrLen + 1);
 }
 const unsigned int EspString::GetLength()const { return StrLen; }
 const unsigned int EspString::GetUpperIndex()const { return StrLen - 1; }
@@ -354,128 +553,45 @@ bool EspString::Compare(const char* lpszStr)const { return EspString::Compare(Bu
 bool EspString::Compare(const EspString& lpszStr)const { return EspString::Compare(Buffer, lpszStr.Buffer); }
 bool EspString::CompareNoCase(const char* lpszStr)const { return EspString::CompareNoCase(Buffer, lpszStr); }
 bool EspString::CompareNoCase(const EspString& lpszStr)const { return EspString::CompareNoCase(Buffer, lpszStr.Buffer); }
+int EspString::CompareOrdinal(const EspString& lpszStr)const { return EspString::CompareOrdinal(Buffer, StrLen, lpszStr.Buffer, lpszStr.StrLen); }
+unsigned long long EspString::GetHash()const
+{
+	unsigned long long Hash = HashCache.load(std::memory_order_relaxed);
+	if (Hash == 0)
+	{
+		//Racing readers compute the same value, so the duplicate stores are harmless
+		Hash = EspString::Hash(Buffer, StrLen);
+		if (Hash == 0)
+			Hash = 1;
+		HashCache.store(Hash, std::memory_order_relaxed);
+	}
+	return Hash;
+}
 
 EspString& EspString::Append(const char& lpszChar)
 {
 	if (Buffer == NULL)
-	{
-		Buffer = (char*)::malloc(10);
-		if (Buffer == NULL)
-			throw("Allocate Buffer Unsuccessfully");
-		::memcpy(Buffer, &lpszChar, sizeof(char));
-		::memset(Buffer + 1, 0, 9 * sizeof(char));
-		StrLen = 1;
-		BufSize = 10;
-	}
-	else
-	{
-		unsigned int NewStrLen = StrLen + 1;
-		if (NewStrLen < BufSize)
-		{
-			::memcpy(Buffer + StrLen, &lpszChar, sizeof(char));
-			StrLen++;
-		}
-		else
-		{
-			unsigned int NewBufLen = NewStrLen * 2;
-			char* NewStrData = (char*)::malloc(NewBufLen * sizeof(char));
-			if (NewStrData == NULL)
-				throw("Allocate Buffer Unsuccessfully");
-			::memcpy_s(NewStrData, NewBufLen * sizeof(char), Buffer, StrLen * sizeof(char));
-			::memcpy(NewStrData + StrLen, &lpszChar, sizeof(char));
-			::memset(NewStrData + NewStrLen, 0, (NewBufLen - NewStrLen) * sizeof(char));
-			StrLen = NewStrLen;
-			BufSize = NewBufLen;
-			::free(Buffer);
-			Buffer = NewStrData;
-		}
-	}
+		ReallocBuffer(10);
+	else if (StrLen + 1 >= BufSize)
+		GrowBuffer(StrLen + 1);
+	Buffer[StrLen++] = lpszChar;
+	Buffer[StrLen] = '\0';
+	ResetHash();
 	return *this;
 }
 EspString& EspString::Append(const char* lpszNewStr)
 {
 	if (lpszNewStr != NULL)
-	{
-		unsigned int NewStrLen = EspString::GetLength(lpszNewStr);
-		if (Buffer == NULL)
-		{
-			unsigned int NewBufSize = NewStrLen + 1;
-			Buffer = (char*)::malloc(NewBufSize * sizeof(char));
-			if (Buffer == NULL)
-				throw("Allocate Buffer Unsuccessfully");
-			::memcpy(Buffer, lpszNewStr, NewStrLen * sizeof(char));
-			Buffer[NewStrLen] = '\0';
-			StrLen = NewStrLen;
-			BufSize = NewBufSize;
-		}
-		else
-		{
-			unsigned int TotalStrLen = StrLen + NewStrLen;
-			if (TotalStrLen < BufSize)
-			{
-				::memcpy(Buffer + StrLen, lpszNewStr, NewStrLen * sizeof(char));
-				StrLen = TotalStrLen;
-			}
-			else
-			{
-				unsigned int NewBufSize = TotalStrLen * 2;
-				char* NewBuffer = (char*)::malloc(NewBufSize * sizeof(char));
-				if (NewBuffer == NULL)
-					throw("Allocate Buffer Unsuccessfully");
-				::memcpy(NewBuffer, Buffer, StrLen * sizeof(char));
-				::memcpy(NewBuffer + StrLen, lpszNewStr, NewStrLen * sizeof(char));
-				::memset(NewBuffer + TotalStrLen, 0, (NewBufSize - TotalStrLen) * sizeof(char));
-				::free(Buffer);
-				Buffer = NewBuffer;
-				StrLen = TotalStrLen;
-				BufSize = NewBufSize;
-			}
-		}
-	}
+		AppendRaw(lpszNewStr, EspString::GetLength(lpszNewStr));
 	return *this;
 }
 EspString& EspString::Append(const EspString& lpszNewStr)
 {
-	if (lpszNewStr != NULL)
-	{
-		unsigned int NewStrLen = lpszNewStr.StrLen;
-		if (Buffer == NULL)
-		{
-			unsigned int NewBufSize = NewStrLen + 1;
-			Buffer = (char*)::malloc(NewBufSize * sizeof(char));
-			if (Buffer == NULL)
-				throw("Allocate Buffer Unsuccessfully");
-			::memcpy(Buffer, lpszNewStr.Buffer, NewStrLen * sizeof(char));
-			Buffer[NewStrLen] = '\0';
-			StrLen = NewStrLen;
-			BufSize = NewBufSize;
-		}
-		else
-		{
-			unsigned int TotalStrLen = StrLen + NewStrLen;
-			if (TotalStrLen < BufSize)
-			{
-				::memcpy(Buffer + StrLen, lpszNewStr.Buffer, NewStrLen * sizeof(char));
-				StrLen = TotalStrLen;
-			}
-			else
-			{
-				unsigned int NewBufSize = TotalStrLen * 2;
-				char* NewBuffer = (char*)::malloc(NewBufSize * sizeof(char));
-				if (NewBuffer == NULL)
-					throw("Allocate Buffer Unsuccessfully");
-				::memcpy(NewBuffer, Buffer, StrLen * sizeof(char));
-				::memcpy(NewBuffer + StrLen, lpszNewStr.Buffer, NewStrLen * sizeof(char));
-				::memset(NewBuffer + TotalStrLen, 0, (NewBufSize - TotalStrLen) * sizeof(char));
-				::free(Buffer);
-				Buffer = NewBuffer;
-				StrLen = TotalStrLen;
-				BufSize = NewBufSize;
-			}
-		}
-	}
+	if (lpszNewStr.Buffer != NULL)
+		AppendRaw(lpszNewStr.Buffer, lpszNewStr.StrLen);
 	return *this;
 }
+EspString& EspString::Append(const char* lpszNewStr, unsigned int nLength) { return AppendRaw(lpszNewStr, nLength); }
 
 EspString& EspString::operator+=(const char& lpszChar) { return Append(lpszChar); }
 EspString& EspString::operator+=(const char* lpszNewStr) { return Append(lpszNewStr); }
@@ -484,146 +600,59 @@ EspString& EspString::operator+=(const EspString& lpszNewStr) { return Append(lp
 EspString& EspString::Assign(const char* lpszNewStr)
 {
 	if (lpszNewStr != NULL)
-	{
-		unsigned int NewStrLen = EspString::GetLength(lpszNewStr);
-		if (Buffer == NULL)
-		{
-			unsigned int NewBufSize = NewStrLen + 1;
-			Buffer = (char*)::malloc(NewBufSize * sizeof(char));
-			if (Buffer == NULL)
-				throw("Allocate Buffer Unsuccessfully");
-			::memcpy(Buffer, lpszNewStr, NewStrLen * sizeof(char));
-			::memset(Buffer + NewStrLen, 0, (NewBufSize - NewStrLen) * sizeof(char));
-			StrLen = NewStrLen;
-			BufSize = NewBufSize;
-		}
-		else
-		{
-			if (NewStrLen < BufSize)
-			{
-				::memset(Buffer, 0, StrLen * sizeof(char));
-				::memcpy(Buffer, lpszNewStr, NewStrLen * sizeof(char));
-				StrLen = NewStrLen;
-			}
-			else
-			{
-				unsigned int NewBufSize = NewStrLen * 2;
-				::free(Buffer);
-				Buffer = (char*)::malloc(NewBufSize * sizeof(char));
-				if (Buffer == NULL)
-					throw("Allocate Buffer Unsuccessfully");
-				::memcpy(Buffer, lpszNewStr, NewStrLen * sizeof(char));
-				::memset(Buffer + NewStrLen, 0, (NewBufSize - NewStrLen) * sizeof(char));
-				StrLen = NewStrLen;
-				BufSize = NewBufSize;
-			}
-		}
-	}
+		AssignRaw(lpszNewStr, EspString::GetLength(lpszNewStr));
 	return *this;
 }
 EspString& EspString::Assign(const EspString& lpszNewStr)
 {
-	if (lpszNewStr != NULL)
-	{
-		unsigned int NewStrLen = lpszNewStr.StrLen;
-		if (Buffer == NULL)
-		{
-			unsigned int NewBufSize = NewStrLen + 1;
-			Buffer = (char*)::malloc(NewBufSize * sizeof(char));
-			if (Buffer == NULL)
-				throw("Allocate Buffer Unsuccessfully");
-			::memcpy(Buffer, lpszNewStr.Buffer, NewStrLen * sizeof(char));
-			::memset(Buffer + NewStrLen, 0, (NewBufSize - NewStrLen) * sizeof(char));
-			StrLen = NewStrLen;
-			BufSize = NewBufSize;
-		}
-		else
-		{
-			if (NewStrLen < BufSize)
-			{
-				::memset(Buffer, 0, StrLen * sizeof(char));
-				::memcpy(Buffer, lpszNewStr.Buffer, NewStrLen * sizeof(char));
-				StrLen = NewStrLen;
-			}
-			else
-			{
-				unsigned int NewBufSize = NewStrLen * 2;
-				::free(Buffer);
-				Buffer = (char*)::malloc(NewBufSize * sizeof(char));
-				if (Buffer == NULL)
-					throw("Allocate Buffer Unsuccessfully");
-				::memcpy(Buffer, lpszNewStr.Buffer, NewStrLen * sizeof(char));
-				::memset(Buffer + NewStrLen, 0, (NewBufSize - NewStrLen) * sizeof(char));
-				StrLen = NewStrLen;
-				BufSize = NewBufSize;
-			}
-		}
-	}
+	if (lpszNewStr.Buffer != NULL && &lpszNewStr != this)
+		AssignRaw(lpszNewStr.Buffer, lpszNewStr.StrLen);
 	return *this;
 }
+EspString& EspString::Assign(const char* lpszNewStr, unsigned int nLength) { return AssignRaw(lpszNewStr, nLength); }
 
 EspString& EspString::operator=(const char* lpszNewStr) { return Assign(lpszNewStr); }
 EspString& EspString::operator=(const EspString& lpszNewStr) { return Assign(lpszNewStr); }
+EspString& EspString::operator=(EspString&& lpszNewStr)
+{
+	if (&lpszNewStr != this)
+	{
+		Swap(lpszNewStr);
+		lpszNewStr.Empty();
+	}
+	return *this;
+}
 
 EspString& EspString::Insert(unsigned int nIndex, const char& lpszChar, unsigned int nCount)
 {
 	if (nIndex > StrLen)
 		nIndex = StrLen;
 	unsigned int TotalStrLen = StrLen + nCount;
-	if (TotalStrLen < BufSize)
-	{
-		::memcpy(Buffer + nIndex + nCount, Buffer + nIndex, (TotalStrLen - nCount - nIndex) * sizeof(char));
-		for (unsigned int TimeNum = 0; TimeNum < nCount; TimeNum++)
-			Buffer[nIndex + TimeNum] = lpszChar;
-		StrLen += nCount;
-	}
-	else
-	{
-		unsigned int NewBufSize = TotalStrLen * 2;
-		char* NewBuffer = (char*)::malloc(NewBufSize * sizeof(char));
-		if (NewBuffer == NULL)
-			throw("Allocate Buffer Unsuccessfully");
-		::memcpy(NewBuffer, Buffer, nIndex * sizeof(char));
-		for (unsigned int TimeNum = 0; TimeNum < nCount; TimeNum++)
-			NewBuffer[nIndex + TimeNum] = lpszChar;
-		::memcpy(NewBuffer + nIndex + nCount, Buffer + nIndex, (TotalStrLen - nCount - nIndex) * sizeof(char));
-		::memset(NewBuffer + TotalStrLen, 0, (NewBufSize - TotalStrLen) * sizeof(char));
-		::free(Buffer);
-		Buffer = NewBuffer;
-		StrLen = TotalStrLen;
-		BufSize = NewBufSize;
-	}
+	GrowBuffer(TotalStrLen);
+	::memmove(Buffer + nIndex + nCount, Buffer + nIndex, (StrLen - nIndex) * sizeof(char));
+	for (unsigned int TimeNum = 0; TimeNum < nCount; TimeNum++)
+		Buffer[nIndex + TimeNum] = lpszChar;
+	StrLen = TotalStrLen;
+	Buffer[StrLen] = '\0';
+	ResetHash();
 	return *this;
 }
 EspString& EspString::Insert(unsigned int nIndex, const char* lpszNewStr)
 {
 	if (lpszNewStr != NULL)
 	{
+		if (Buffer != NULL && lpszNewStr >= Buffer && lpszNewStr < Buffer + BufSize)
+			return Insert(nIndex, EspString(lpszNewStr));
 		if (nIndex > StrLen)
 			nIndex = StrLen;
 		unsigned int NewStrLen = EspString::GetLength(lpszNewStr);
 		unsigned int TotalStrLen = StrLen + NewStrLen;
-		if (TotalStrLen < BufSize)
-		{
-			::memcpy(Buffer + nIndex + NewStrLen, Buffer + nIndex, (TotalStrLen - nIndex - NewStrLen) * sizeof(char));
-			::memcpy(Buffer + nIndex, lpszNewStr, NewStrLen * sizeof(char));
-			StrLen = TotalStrLen;
-		}
-		else
-		{
-			unsigned int NewBufSize = TotalStrLen * 2;
-			char* NewBuffer = (char*)::malloc(NewBufSize * sizeof(char));
-			if (NewBuffer == NULL)
-				throw("Allocate Buffer Unsuccessfully");
-			::memcpy(NewBuffer, Buffer, nIndex * sizeof(char));
-			::memcpy(NewBuffer + nIndex + NewStrLen, Buffer + nIndex, (TotalStrLen - NewStrLen - nIndex) * sizeof(char));
-			::memcpy(NewBuffer + nIndex, lpszNewStr, NewStrLen * sizeof(char));
-			::memset(NewBuffer + TotalStrLen, 0, (NewBufSize - TotalStrLen) * sizeof(char));
-			::free(Buffer);
-			Buffer = NewBuffer;
-			StrLen = TotalStrLen;
-			BufSize = NewBufSize;
-		}
+		GrowBuffer(TotalStrLen);
+		::memmove(Buffer + nIndex + NewStrLen, Buffer + nIndex, (StrLen - nIndex) * sizeof(char));
+		::memcpy(Buffer + nIndex, lpszNewStr, NewStrLen * sizeof(char));
+		StrLen = TotalStrLen;
+		Buffer[StrLen] = '\0';
+		ResetHash();
 	}
 	return *this;
 }
@@ -631,48 +660,39 @@ EspString& EspString::Insert(unsigned int nIndex, const EspString& lpszNewStr)
 {
 	if (!lpszNewStr.IsEmpty())
 	{
+		if (&lpszNewStr == this)
+			return Insert(nIndex, EspString(lpszNewStr));
 		if (nIndex > StrLen)
 			nIndex = StrLen;
 		unsigned int NewStrLen = lpszNewStr.StrLen;
 		unsigned int TotalStrLen = StrLen + NewStrLen;
-		if (TotalStrLen < BufSize)
-		{
-			::memcpy(Buffer + nIndex + NewStrLen, Buffer + nIndex, (TotalStrLen - nIndex - NewStrLen) * sizeof(char));
-			::memcpy(Buffer + nIndex, lpszNewStr.Buffer, NewStrLen * sizeof(char));
-			StrLen = TotalStrLen;
-		}
-		else
-		{
-			unsigned int NewBufSize = TotalStrLen * 2;
-			char* NewBuffer = (char*)::malloc(NewBufSize * sizeof(char));
-			if (NewBuffer == NULL)
-				throw("Allocate Buffer Unsuccessfully");
-			::memcpy(NewBuffer, Buffer, nIndex * sizeof(char));
-			::memcpy(NewBuffer + nIndex + NewStrLen, Buffer + nIndex, (TotalStrLen - NewStrLen - nIndex) * sizeof(char));
-			::memcpy(NewBuffer + nIndex, lpszNewStr.Buffer, NewStrLen * sizeof(char));
-			::memset(NewBuffer + TotalStrLen, 0, (NewBufSize - TotalStrLen) * sizeof(char));
-			::free(Buffer);
-			Buffer = NewBuffer;
-			StrLen = TotalStrLen;
-			BufSize = NewBufSize;
-		}
+		GrowBuffer(TotalStrLen);
+		::memmove(Buffer + nIndex + NewStrLen, Buffer + nIndex, (StrLen - nIndex) * sizeof(char));
+		::memcpy(Buffer + nIndex, lpszNewStr.Buffer, NewStrLen * sizeof(char));
+		StrLen = TotalStrLen;
+		Buffer[StrLen] = '\0';
+		ResetHash();
 	}
 	return *this;
 }
 
 EspString& EspString::Remove(unsigned int nIndex, unsigned int nCount)
 {
+	if (StrLen == 0)
+		return *this;
 	if (nIndex > StrLen - 1)
 	{
 		nIndex = StrLen - 1;
 		nCount = 1;
 	}
-	unsigned int NewStrLen = StrLen - nCount;
+	if (nCount > StrLen - nIndex)
+		nCount = StrLen - nIndex;
 	if (nCount > 0)
 	{
-		::memcpy(Buffer + nIndex, Buffer + nIndex + nCount, ::abs((signed int)(NewStrLen - (nIndex + nCount) + 1)) * sizeof(char));
-		::memset(Buffer + NewStrLen, 0, (BufSize - NewStrLen) * sizeof(char));
-		StrLen = NewStrLen;
+		::memmove(Buffer + nIndex, Buffer + nIndex + nCount, (StrLen - nIndex - nCount) * sizeof(char));
+		StrLen -= nCount;
+		Buffer[StrLen] = '\0';
+		ResetHash();
 	}
 	return *this;
 }
@@ -681,29 +701,15 @@ EspString& EspString::Replace(unsigned int nIndex, unsigned int nLength, const c
 {
 	if (Buffer != NULL && lpszNewStr != NULL)
 	{
+		if (lpszNewStr >= Buffer && lpszNewStr < Buffer + BufSize)
+			return Replace(nIndex, nLength, EspString(lpszNewStr));
 		unsigned int NewStrLen = EspString::GetLength(lpszNewStr);
 		unsigned int TotalStrLen = StrLen - nLength + NewStrLen;
-		if (TotalStrLen < BufSize)
-		{
-			::memcpy(Buffer + nIndex + NewStrLen, Buffer + nIndex + nLength, (StrLen - nIndex - nLength + 1) * sizeof(char));
-			::memcpy(Buffer + nIndex, lpszNewStr, NewStrLen * sizeof(char));
-			StrLen = TotalStrLen;
-		}
-		else
-		{
-			unsigned int NewBufSize = TotalStrLen * 2;
-			char* NewBuffer = (char*)::malloc(NewBufSize * sizeof(char));
-			if (NewBuffer == NULL)
-				throw("Allocate Buffer Unsuccessfully");
-			::memcpy(NewBuffer, Buffer, nIndex * sizeof(char));
-			::memcpy(NewBuffer + nIndex, lpszNewStr, NewStrLen * sizeof(char));
-			::memcpy(NewBuffer + nIndex + NewStrLen, Buffer + nIndex + nLength, (StrLen - nIndex - nLength + 1) * sizeof(char));
-			::memset(NewBuffer + TotalStrLen, 0, (NewBufSize - TotalStrLen) * sizeof(char));
-			::free(Buffer);
-			Buffer = NewBuffer;
-			StrLen = TotalStrLen;
-			BufSize = NewBufSize;
-		}
+		GrowBuffer(TotalStrLen);
+		::memmove(Buffer + nIndex + NewStrLen, Buffer + nIndex + nLength, (StrLen - nIndex - nLength + 1) * sizeof(char));
+		::memcpy(Buffer + nIndex, lpszNewStr, NewStrLen * sizeof(char));
+		StrLen = TotalStrLen;
+		ResetHash();
 	}
 	return *this;
 }
@@ -723,9 +729,26 @@ EspString& EspString::Replace(const char* lpszOldStr, const char* lpszNewStr)
 EspString& EspString::Reverse()
 {
 	EspString::Reverse(Buffer);
+	ResetHash();
 	return *this;
 }
 
+void EspString::Swap(EspString& lpszStr)
+{
+	char* TempBuffer = Buffer;
+	Buffer = lpszStr.Buffer;
+	lpszStr.Buffer = TempBuffer;
+	unsigned int TempSize = StrLen;
+	StrLen = lpszStr.StrLen;
+	lpszStr.StrLen = TempSize;
+	TempSize = BufSize;
+	BufSize = lpszStr.BufSize;
+	lpszStr.BufSize = TempSize;
+	unsigned long long TempHash = HashCache.load(std::memory_order_relaxed);
+	HashCache.store(lpszStr.HashCache.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	lpszStr.HashCache.store(TempHash, std::memory_order_relaxed);
+}
+
 EspString EspString::Left(unsigned int nIndex)const
 {
 	EspString Result;
@@ -761,6 +784,428 @@ EspString EspString::Middle(const EspString& lpszStartStr, const EspString& lpsz
 	return Result;
 }
 
+unsigned int EspString::CountBits(unsigned int Mask)
+{
+	Mask = Mask - ((Mask >> 1) & 0x55555555);
+	Mask = (Mask & 0x33333333) + ((Mask >> 2) & 0x33333333);
+	return (((Mask + (Mask >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24;
+}
+bool EspString::IsValidUtf8Scalar(const unsigned char* Pos, const unsigned char* End)
+{
+	while (Pos < End)
+	{
+		unsigned char Lead = *Pos;
+		if (Lead < 0x80)
+		{
+			Pos++;
+			continue;
+		}
+		unsigned int SeqLen;
+		unsigned char Min = 0x80, Max = 0xBF;
+		if (Lead >= 0xC2 && Lead <= 0xDF)
+			SeqLen = 2;
+		else if (Lead >= 0xE0 && Lead <= 0xEF)
+		{
+			SeqLen = 3;
+			if (Lead == 0xE0)
+				Min = 0xA0;
+			else if (Lead == 0xED)
+				Max = 0x9F;
+		}
+		else if (Lead >= 0xF0 && Lead <= 0xF4)
+		{
+			SeqLen = 4;
+			if (Lead == 0xF0)
+				Min = 0x90;
+			else if (Lead == 0xF4)
+				Max = 0x8F;
+		}
+		else
+			return false;
+		if ((unsigned int)(End - Pos) < SeqLen || Pos[1] < Min || Pos[1] > Max)
+			return false;
+		for (unsigned int TimeNum = 2; TimeNum < SeqLen; TimeNum++)
+			if ((Pos[TimeNum] & 0xC0) != 0x80)
+				return false;
+		Pos += SeqLen;
+	}
+	return true;
+}
+#if defined(__ESPSTRING_SSSE3__)
+bool EspString::IsValidUtf8Ssse3(const unsigned char* Pos, const unsigned char* End)
+{
+	//Keiser-Lemire lookup validation: three nibble tables classify every (previous byte, byte) pair
+	const char TooShort = 1 << 0, TooLong = 1 << 1, Overlong3 = 1 << 2, TooLarge = 1 << 3;
+	const char Surrogate = 1 << 4, Overlong2 = 1 << 5, TooLarge1000 = 1 << 6, Overlong4 = 1 << 6;
+	const char TwoConts = (char)(1 << 7), Carry = TooShort | TooLong | TwoConts;
+	const __m128i Byte1HighTable = _mm_setr_epi8(TooLong, TooLong, TooLong, TooLong, TooLong, TooLong, TooLong, TooLong,
+		TwoConts, TwoConts, TwoConts, TwoConts, TooShort | Overlong2, TooShort, TooShort | Overlong3 | Surrogate,
+		TooShort | TooLarge | TooLarge1000 | Overlong4);
+	const __m128i Byte1LowTable = _mm_setr_epi8(Carry | Overlong3 | Overlong2 | Overlong4, Carry | Overlong2, Carry, Carry,
+		Carry | TooLarge, Carry | TooLarge | TooLarge1000, Carry | TooLarge | TooLarge1000, Carry | TooLarge | TooLarge1000,
+		Carry | TooLarge | TooLarge1000, Carry | TooLarge | TooLarge1000, Carry | TooLarge | TooLarge1000, Carry | TooLarge | TooLarge1000,
+		Carry | TooLarge | TooLarge1000, Carry | TooLarge | TooLarge1000 | Surrogate, Carry | TooLarge | TooLarge1000, Carry | TooLarge | TooLarge1000);
+	const __m128i Byte2HighTable = _mm_setr_epi8(TooShort, TooShort, TooShort, TooShort, TooShort, TooShort, TooShort, TooShort,
+		TooLong | Overlong2 | TwoConts | Overlong3 | TooLarge1000 | Overlong4, TooLong | Overlong2 | TwoConts | Overlong3 | TooLarge,
+		TooLong | Overlong2 | TwoConts | Surrogate | TooLarge, TooLong | Overlong2 | TwoConts | Surrogate | TooLarge,
+		TooShort, TooShort, TooShort, TooShort);
+	const __m128i IncompleteMax = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, (char)(0xF0 - 1), (char)(0xE0 - 1), (char)(0xC0 - 1));
+	const __m128i LowNibble = _mm_set1_epi8(0x0F);
+	__m128i PrevInput = _mm_setzero_si128();
+	__m128i PrevIncomplete = _mm_setzero_si128();
+	__m128i Error = _mm_setzero_si128();
+	unsigned char Tail[16];
+	while (Pos < End)
+	{
+		__m128i Input;
+		if (End - Pos >= 16)
+			Input = _mm_loadu_si128((const __m128i*)Pos);
+		else
+		{
+			::memset(Tail, 0, sizeof(Tail));
+			::memcpy(Tail, Pos, End - Pos);
+			Input = _mm_loadu_si128((const __m128i*)Tail);
+		}
+		Pos += 16;
+		if (_mm_movemask_epi8(Input) == 0)
+		{
+			Error = _mm_or_si128(Error, PrevIncomplete);
+			PrevIncomplete = _mm_setzero_si128();
+			PrevInput = Input;
+			continue;
+		}
+		__m128i Prev1 = _mm_alignr_epi8(Input, PrevInput, 15);
+		__m128i Byte1High = _mm_shuffle_epi8(Byte1HighTable, _mm_and_si128(_mm_srli_epi16(Prev1, 4), LowNibble));
+		__m128i Byte1Low = _mm_shuffle_epi8(Byte1LowTable, _mm_and_si128(Prev1, LowNibble));
+		__m128i Byte2High = _mm_shuffle_epi8(Byte2HighTable, _mm_and_si128(_mm_srli_epi16(Input, 4), LowNibble));
+		__m128i Special = _mm_and_si128(_mm_and_si128(Byte1High, Byte1Low), Byte2High);
+		__m128i Prev2 = _mm_alignr_epi8(Input, PrevInput, 14);
+		__m128i Prev3 = _mm_alignr_epi8(Input, PrevInput, 13);
+		__m128i Must23 = _mm_or_si128(_mm_subs_epu8(Prev2, _mm_set1_epi8(0xE0 - 0x80)), _mm_subs_epu8(Prev3, _mm_set1_epi8((char)(0xF0 - 0x80))));
+		Error = _mm_or_si128(Error, _mm_xor_si128(_mm_and_si128(Must23, _mm_set1_epi8((char)0x80)), Special));
+		PrevIncomplete = _mm_subs_epu8(Input, IncompleteMax);
+		PrevInput = Input;
+	}
+	Error = _mm_or_si128(Error, PrevIncomplete);
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(Error, _mm_setzero_si128())) == 0xFFFF;
+}
+#endif
+#if defined(__ESPSTRING_SSE2__)
+bool EspString::IsValidUtf8Sse2(const unsigned char* Pos, const unsigned char* End)
+{
+	while (Pos < End)
+	{
+		while (End - Pos >= 16 && _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)Pos)) == 0)
+			Pos += 16;
+		const unsigned char* BlockEnd = End - Pos > 64 ? Pos + 64 : End;
+		while (BlockEnd < End && (*BlockEnd & 0xC0) == 0x80)
+			BlockEnd++;
+		if (!EspString::IsValidUtf8Scalar(Pos, BlockEnd))
+			return false;
+		Pos = BlockEnd;
+	}
+	return true;
+}
+#endif
+bool EspString::IsValidUtf8(const char* lpszStr, unsigned int nLength)
+{
+	const unsigned char* Pos = (const unsigned char*)lpszStr;
+	const unsigned char* End = Pos + nLength;
+#if defined(__ESPSTRING_SSSE3_CPUID__)
+	static const bool HasSsse3 = EspString::CpuHasSsse3();
+	return HasSsse3 ? EspString::IsValidUtf8Ssse3(Pos, End) : EspString::IsValidUtf8Sse2(Pos, End);
+#elif defined(__ESPSTRING_SSSE3__)
+	return EspString::IsValidUtf8Ssse3(Pos, End);
+#elif defined(__ESPSTRING_SSE2__)
+	return EspString::IsValidUtf8Sse2(Pos, End);
+#else
+	return EspString::IsValidUtf8Scalar(Pos, End);
+#endif
+}
+unsigned int EspString::CountCodePoints(const char* lpszStr, unsigned int nLength)
+{
+	const unsigned char* Pos = (const unsigned char*)lpszStr;
+	const unsigned char* End = Pos + nLength;
+	unsigned int Result = 0;
+#if defined(__ESPSTRING_SSE2__)
+	//Every byte outside 0x80-0xBF starts a code point; as signed bytes those are the ones above -65
+	const __m128i ContinuationMax = _mm_set1_epi8(-65);
+	for (; End - Pos >= 16; Pos += 16)
+		Result += EspString::CountBits(_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_loadu_si128((const __m128i*)Pos), ContinuationMax)));
+#endif
+	for (; Pos < End; Pos++)
+		if ((*Pos & 0xC0) != 0x80)
+			Result++;
+	return Result;
+}
+bool EspString::FromUtf16(const unsigned short* lpszWStr, unsigned int nLength, EspString& Result)
+{
+	unsigned int NewStrLen = 0;
+	for (unsigned int TimeNum = 0; TimeNum < nLength; TimeNum++)
+	{
+		unsigned short Unit = lpszWStr[TimeNum];
+		if (Unit < 0x80)
+			NewStrLen += 1;
+		else if (Unit < 0x800)
+			NewStrLen += 2;
+		else if (Unit < 0xD800 || Unit > 0xDFFF)
+			NewStrLen += 3;
+		else if (Unit <= 0xDBFF && TimeNum + 1 < nLength && lpszWStr[TimeNum + 1] >= 0xDC00 && lpszWStr[TimeNum + 1] <= 0xDFFF)
+		{
+			NewStrLen += 4;
+			TimeNum++;
+		}
+		else
+			return false;
+	}
+	unsigned char* Pos = (unsigned char*)Result.GetBufferSetLength(NewStrLen);
+	unsigned int TimeNum = 0;
+	while (TimeNum < nLength)
+	{
+#if defined(__ESPSTRING_SSE2__)
+		while (nLength - TimeNum >= 8)
+		{
+			__m128i Units = _mm_loadu_si128((const __m128i*)(lpszWStr + TimeNum));
+			if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(Units, _mm_set1_epi16((short)0xFF80)), _mm_setzero_si128())) != 0xFFFF)
+				break;
+			_mm_storel_epi64((__m128i*)Pos, _mm_packus_epi16(Units, Units));
+			Pos += 8;
+			TimeNum += 8;
+		}
+		if (TimeNum >= nLength)
+			break;
+#endif
+		unsigned int CodePoint = lpszWStr[TimeNum++];
+		if (CodePoint < 0x80)
+			*Pos++ = (unsigned char)CodePoint;
+		else if (CodePoint < 0x800)
+		{
+			*Pos++ = (unsigned char)(0xC0 | (CodePoint >> 6));
+			*Pos++ = (unsigned char)(0x80 | (CodePoint & 0x3F));
+		}
+		else if (CodePoint < 0xD800 || CodePoint > 0xDFFF)
+		{
+			*Pos++ = (unsigned char)(0xE0 | (CodePoint >> 12));
+			*Pos++ = (unsigned char)(0x80 | ((CodePoint >> 6) & 0x3F));
+			*Pos++ = (unsigned char)(0x80 | (CodePoint & 0x3F));
+		}
+		else
+		{
+			CodePoint = 0x10000 + ((CodePoint - 0xD800) << 10) + (lpszWStr[TimeNum++] - 0xDC00);
+			*Pos++ = (unsigned char)(0xF0 | (CodePoint >> 18));
+			*Pos++ = (unsigned char)(0x80 | ((CodePoint >> 12) & 0x3F));
+			*Pos++ = (unsigned char)(0x80 | ((CodePoint >> 6) & 0x3F));
+			*Pos++ = (unsigned char)(0x80 | (CodePoint & 0x3F));
+		}
+	}
+	return true;
+}
+unsigned int EspString::ToUtf16(unsigned short* lpszWBuffer, unsigned int nBufLength)const
+{
+	if (!EspString::IsValidUtf8(Buffer, StrLen))
+		return -1;
+	const unsigned char* Pos = (const unsigned char*)Buffer;
+	const unsigned char* End = Pos + StrLen;
+	unsigned int NewLength = EspString::CountCodePoints(Buffer, StrLen);
+	for (const unsigned char* Scan = Pos; Scan < End; Scan++)
+		if (*Scan >= 0xF0)
+			NewLength++;
+	if (lpszWBuffer == NULL)
+		return NewLength;
+	if (nBufLength < NewLength)
+		return -1;
+	unsigned short* Out = lpszWBuffer;
+	while (Pos < End)
+	{
+#if defined(__ESPSTRING_SSE2__)
+		while (End - Pos >= 16)
+		{
+			__m128i Bytes = _mm_loadu_si128((const __m128i*)Pos);
+			if (_mm_movemask_epi8(Bytes) != 0)
+				break;
+			_mm_storeu_si128((__m128i*)Out, _mm_unpacklo_epi8(Bytes, _mm_setzero_si128()));
+			_mm_storeu_si128((__m128i*)(Out + 8), _mm_unpackhi_epi8(Bytes, _mm_setzero_si128()));
+			Pos += 16;
+			Out += 16;
+		}
+		if (Pos >= End)
+			break;
+#endif
+		unsigned int CodePoint = *Pos++;
+		if (CodePoint >= 0xF0)
+		{
+			CodePoint = ((CodePoint & 0x07) << 18) | ((Pos[0] & 0x3F) << 12) | ((Pos[1] & 0x3F) << 6) | (Pos[2] & 0x3F);
+			Pos += 3;
+			CodePoint -= 0x10000;
+			*Out++ = (unsigned short)(0xD800 + (CodePoint >> 10));
+			*Out++ = (unsigned short)(0xDC00 + (CodePoint & 0x3FF));
+			continue;
+		}
+		if (CodePoint >= 0xE0)
+		{
+			CodePoint = ((CodePoint & 0x0F) << 12) | ((Pos[0] & 0x3F) << 6) | (Pos[1] & 0x3F);
+			Pos += 2;
+		}
+		else if (CodePoint >= 0xC0)
+			CodePoint = ((CodePoint & 0x1F) << 6) | (*Pos++ & 0x3F);
+		*Out++ = (unsigned short)CodePoint;
+	}
+	return NewLength;
+}
+bool EspString::IsValidUtf8()const { return EspString::IsValidUtf8(Buffer, StrLen); }
+unsigned int EspString::GetCodePointCount()const { return EspString::CountCodePoints(Buffer, StrLen); }
+
+void swap(EspString& lpszStr1, EspString& lpszStr2) { lpszStr1.Swap(lpszStr2); }
+
+class EspStringSorter
+{
+private:
+	static const unsigned int InsertionSortThreshold = 16;
+	static const unsigned int RadixThreshold = 1 << 12;
+
+	static int GetKey(const EspString& lpszStr, unsigned int Depth)
+	{
+		return Depth < lpszStr.GetLength() ? (unsigned char)lpszStr.GetAnsiStr()[Depth] : -1;
+	}
+	static bool IsLess(const EspString& lpszStr1, const EspString& lpszStr2, unsigned int Depth)
+	{
+		return EspString::CompareOrdinal(lpszStr1.GetAnsiStr() + Depth, lpszStr1.GetLength() - Depth, lpszStr2.GetAnsiStr() + Depth, lpszStr2.GetLength() - Depth) < 0;
+	}
+	static void InsertionSort(EspString* ArrayData, unsigned int ArraySize, unsigned int Depth)
+	{
+		for (unsigned int TimeNum = 1; TimeNum < ArraySize; TimeNum++)
+			for (unsigned int Pos = TimeNum; Pos > 0 && EspStringSorter::IsLess(ArrayData[Pos], ArrayData[Pos - 1], Depth); Pos--)
+				ArrayData[Pos].Swap(ArrayData[Pos - 1]);
+	}
+	//Bentley-Sedgewick multikey quicksort: three-way partition on the character at Depth
+	static void MultikeySort(EspString* ArrayData, unsigned int ArraySize, unsigned int Depth)
+	{
+		while (ArraySize > InsertionSortThreshold)
+		{
+			int Key1 = EspStringSorter::GetKey(ArrayData[0], Depth);
+			int Key2 = EspStringSorter::GetKey(ArrayData[ArraySize / 2], Depth);
+			int Key3 = EspStringSorter::GetKey(ArrayData[ArraySize - 1], Depth);
+			int Pivot = Key1 < Key2 ? (Key2 < Key3 ? Key2 : (Key1 < Key3 ? Key3 : Key1)) : (Key1 < Key3 ? Key1 : (Key2 < Key3 ? Key3 : Key2));
+			unsigned int Less = 0, Pos = 0, Greater = ArraySize;
+			while (Pos < Greater)
+			{
+				int Key = EspStringSorter::GetKey(ArrayData[Pos], Depth);
+				if (Key < Pivot)
+					ArrayData[Less++].Swap(ArrayData[Pos++]);
+				else if (Key > Pivot)
+					ArrayData[Pos].Swap(ArrayData[--Greater]);
+				else
+					Pos++;
+			}
+			//Recurse into the two smaller parts and loop on the largest: a part that is not the largest holds at most
+			//half the strings, so the stack stays within log2(ArraySize) frames however long the shared prefixes are
+			unsigned int LessSize = Less;
+			unsigned int EqualSize = Pivot == -1 ? 0 : Greater - Less;
+			unsigned int GreaterSize = ArraySize - Greater;
+			if (LessSize >= EqualSize && LessSize >= GreaterSize)
+			{
+				EspStringSorter::MultikeySort(ArrayData + Less, EqualSize, Depth + 1);
+				EspStringSorter::MultikeySort(ArrayData + Greater, GreaterSize, Depth);
+				ArraySize = LessSize;
+			}
+			else if (GreaterSize >= EqualSize)
+			{
+				EspStringSorter::MultikeySort(ArrayData, LessSize, Depth);
+				EspStringSorter::MultikeySort(ArrayData + Less, EqualSize, Depth + 1);
+				ArrayData += Greater;
+				ArraySize = GreaterSize;
+			}
+			else
+			{
+				EspStringSorter::MultikeySort(ArrayData, LessSize, Depth);
+				EspStringSorter::MultikeySort(ArrayData + Greater, GreaterSize, Depth);
+				ArrayData += Less;
+				ArraySize = EqualSize;
+				Depth++;
+			}
+		}
+		EspStringSorter::InsertionSort(ArrayData, ArraySize, Depth);
+	}
+	//American flag sort: one in-place 257-way distribution on the character at Depth (bucket 0 holds strings that end here)
+	static void Distribute(EspString* ArrayData, unsigned int ArraySize, unsigned int Depth, unsigned int* BucketStart)
+	{
+		unsigned int Counts[257] = { 0 };
+		for (unsigned int TimeNum = 0; TimeNum < ArraySize; TimeNum++)
+			Counts[EspStringSorter::GetKey(ArrayData[TimeNum], Depth) + 1]++;
+		unsigned int Next[257];
+		BucketStart[0] = Next[0] = 0;
+		for (unsigned int Bucket = 1; Bucket <= 257; Bucket++)
+		{
+			BucketStart[Bucket] = BucketStart[Bucket - 1] + Counts[Bucket - 1];
+			if (Bucket < 257)
+				Next[Bucket] = BucketStart[Bucket];
+		}
+		for (unsigned int Bucket = 0; Bucket < 257; Bucket++)
+			while (Next[Bucket] < BucketStart[Bucket + 1])
+			{
+				unsigned int Target = EspStringSorter::GetKey(ArrayData[Next[Bucket]], Depth) + 1;
+				if (Target == Bucket)
+					Next[Bucket]++;
+				else
+					ArrayData[Next[Bucket]].Swap(ArrayData[Next[Target]++]);
+			}
+	}
+	//Like MultikeySort, recurses only into buckets other than the largest, which hold at most half the strings each
+	static void RadixSort(EspString* ArrayData, unsigned int ArraySize, unsigned int Depth)
+	{
+		while (ArraySize >= RadixThreshold)
+		{
+			unsigned int BucketStart[258];
+			EspStringSorter::Distribute(ArrayData, ArraySize, Depth, BucketStart);
+			unsigned int Largest = 1;
+			for (unsigned int Bucket = 2; Bucket < 257; Bucket++)
+				if (BucketStart[Bucket + 1] - BucketStart[Bucket] > BucketStart[Largest + 1] - BucketStart[Largest])
+					Largest = Bucket;
+			for (unsigned int Bucket = 1; Bucket < 257; Bucket++)
+				if (Bucket != Largest)
+					EspStringSorter::RadixSort(ArrayData + BucketStart[Bucket], BucketStart[Bucket + 1] - BucketStart[Bucket], Depth + 1);
+			ArraySize = BucketStart[Largest + 1] - BucketStart[Largest];
+			ArrayData += BucketStart[Largest];
+			Depth++;
+		}
+		EspStringSorter::MultikeySort(ArrayData, ArraySize, Depth);
+	}
+
+public:
+	static void Sort(EspString* ArrayData, unsigned int ArraySize, bool Parallel = false)
+	{
+		unsigned int Threads = Parallel ? std::thread::hardware_concurrency() : 1;
+		if (Threads <= 1 || ArraySize < RadixThreshold * 4)
+		{
+			EspStringSorter::RadixSort(ArrayData, ArraySize, 0);
+			return;
+		}
+		unsigned int BucketStart[258];
+		EspStringSorter::Distribute(ArrayData, ArraySize, 0, BucketStart);
+		std::atomic<unsigned int> NextBucket(1);
+		auto SortBuckets = [&]()
+		{
+			for (unsigned int Bucket = NextBucket++; Bucket < 257; Bucket = NextBucket++)
+				EspStringSorter::RadixSort(ArrayData + BucketStart[Bucket], BucketStart[Bucket + 1] - BucketStart[Bucket], 1);
+		};
+		//Joins the threads already started even when starting the next one throws
+		struct EspThreadJoiner
+		{
+			std::unique_ptr<std::thread[]> Threads;
+			unsigned int Count;
+			~EspThreadJoiner()
+			{
+				for (unsigned int TimeNum = 0; TimeNum < Count; TimeNum++)
+					Threads[TimeNum].join();
+			}
+		} Joiner = { std::unique_ptr<std::thread[]>(new std::thread[Threads - 1]), 0 };
+		for (; Joiner.Count < Threads - 1; Joiner.Count++)
+			Joiner.Threads[Joiner.Count] = std::thread(SortBuckets);
+		SortBuckets();
+	}
+};
+void EspSortElements(EspString* ArrayData, unsigned int ArraySize, bool Parallel) { EspStringSorter::Sort(ArrayData, ArraySize, Parallel); }
+
 #ifdef __ESPARRAY__
 void EspSplitString(const EspString& lpszStr, const char lpszSymbol, EspArray<EspString>& Result, unsigned int nCount = 0)
 {
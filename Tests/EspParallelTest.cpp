@@ -0,0 +1,54 @@
+#include<assert.h>
+#include<stdio.h>
+#include<string.h>
+#include"../EspParallel.hpp"
+
+//A throwing Func must reach the caller after every queued piece has run, without touching freed state
+static void TestParallelForThrows()
+{
+	EspThreadPool Pool(4);
+	for (unsigned int Round = 0; Round < 100; Round++)
+	{
+		std::atomic<unsigned int> Visited(0);
+		bool Caught = false;
+		try
+		{
+			EspParallelFor(1 << 12, 16, [&Visited](unsigned int Begin, unsigned int End)
+				{
+					Visited += End - Begin;
+					if (Begin == 0)
+						throw("First Chunk Failed!");
+				}, Pool);
+		}
+		catch (const char*)
+		{
+			Caught = true;
+		}
+		assert(Caught);
+		assert(Visited.load() > 0);
+	}
+}
+static void TestParallelForCovers()
+{
+	EspThreadPool Pool(4);
+	EspArray<unsigned int> Hits;
+	Hits.Resize(10000);
+	for (unsigned int TimeNum = 0; TimeNum < Hits.GetCount(); TimeNum++)
+		Hits.GetElementAt(TimeNum) = 0;
+	unsigned int* HitData = Hits.GetBuffer();
+	EspParallelFor(Hits.GetCount(), 7, [HitData](unsigned int Begin, unsigned int End)
+		{
+			for (unsigned int TimeNum = Begin; TimeNum < End; TimeNum++)
+				HitData[TimeNum]++;
+		}, Pool);
+	for (unsigned int TimeNum = 0; TimeNum < Hits.GetCount(); TimeNum++)
+		assert(Hits.GetElementAt(TimeNum) == 1);
+}
+
+int main()
+{
+	TestParallelForCovers();
+	TestParallelForThrows();
+	printf("EspParallelTest passed\n");
+	return 0;
+}